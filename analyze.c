@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <string.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "gc.h"
+#include "symbol.h"
+#include "global.h"
+#include "analyze.h"
+#include "interpreter.h"
+
+// The names of the special forms, interned by startAnalyzer so that analyze
+// can recognise them by pointer.
+Value *ifSymbol, *letSymbol, *quoteSymbol, *defineSymbol, *lambdaSymbol,
+  *letStarSymbol, *letrecSymbol, *setSymbol, *beginSymbol, *condSymbol,
+  *andSymbol, *orSymbol, *elseSymbol;
+
+void startAnalyzer()
+{
+  ifSymbol = intern("if");
+  letSymbol = intern("let");
+  quoteSymbol = intern("quote");
+  defineSymbol = intern("define");
+  lambdaSymbol = intern("lambda");
+  letStarSymbol = intern("let*");
+  letrecSymbol = intern("letrec");
+  setSymbol = intern("set!");
+  beginSymbol = intern("begin");
+  condSymbol = intern("cond");
+  andSymbol = intern("and");
+  orSymbol = intern("or");
+  elseSymbol = intern("else");
+}
+
+// Nothing here reaches eval, so nothing needs roots: the collector can't run
+// until the finished tree is executed.
+
+// The names bound by the forms enclosing the one being analyzed, innermost
+// first, one scope per frame they will make. Only the first count names of
+// a scope are visible yet, which is how let* hides its later bindings.
+typedef struct Scope {
+  Value **names;
+  int count;
+  struct Scope *parent;
+} Scope;
+
+static Node *analyzeIn(Value *expr, Scope *scope);
+
+static Node *newNode(nodeType type, int count, Value *value)
+{
+  Node *node = gcAllocNode(count);
+  node->type = type;
+  node->count = count;
+  node->value = value;
+  countAlloc(SITE_ANALYZE, NODE_STAT, sizeof(Node) + sizeof(Node *) * count);
+  return(node);
+}
+
+static Node *errorNode(char *message)
+{
+  Value *string = gcAllocValue();
+  string->type = STR_TYPE;
+  string->s = message;
+  countAlloc(SITE_ANALYZE, STR_TYPE, sizeof(Value));
+  return(newNode(ERROR_NODE, 0, string));
+}
+
+// A node with a kid for each expression in the list exprs, after the first
+// skip kids, which the caller fills in.
+static Node *sequenceNode(nodeType type, Value *exprs, int skip, Value *value,
+                          Scope *scope)
+{
+  Node *node = newNode(type, skip + length(exprs), value);
+  for (int i = skip; i < node->count; i++) {
+    node->kids[i] = analyzeIn(car(exprs), scope);
+    exprs = cdr(exprs);
+  }
+  return(node);
+}
+
+// Whether node is a constant or a variable, which runs without running
+// anything else.
+static int isLeaf(Node *node)
+{
+  return(node->type == CONST_NODE || node->type == LOCAL_NODE ||
+         node->type == GLOBAL_NODE);
+}
+
+// Finds which frame and slot symbol is bound in, searching each scope from
+// its last visible name back so that a later binding of a name wins. Returns
+// 0 for a global.
+static int resolve(Value *symbol, Scope *scope, int *depth, int *slot)
+{
+  for (int up = 0; scope != NULL; up++, scope = scope->parent) {
+    for (int i = scope->count - 1; i >= 0; i--) {
+      if (scope->names[i] == symbol) {
+        *depth = up;
+        *slot = i;
+        return(1);
+      }
+    }
+  }
+  return(0);
+}
+
+// let, let* and letrec: (let ((name expr) ...) body). Only the first
+// expression of the body is used, as it always has been. A binding without a
+// symbol gets an error where its expression would be, which is where let and
+// let* check it; letrec checks every name before evaluating anything.
+static Node *analyzeLet(nodeType type, Value *args, char *notSymbol, Scope *scope)
+{
+  if (typeOf(args) != CONS_TYPE || typeOf(cdr(args)) != CONS_TYPE) {
+    return(errorNode(type == LET_NODE ? "Too few args for let\n" :
+                     type == LETSTAR_NODE ? "Too few args for let*\n" :
+                     "Too few args for letrec\n"));
+  }
+  Value *bindings = car(args);
+  int count = 0;
+  for (Value *binding = bindings; typeOf(binding) == CONS_TYPE; binding = cdr(binding)) {
+    count++;
+  }
+
+  Value **names = talloc(sizeof(Value *) * (count + 1)); // + 1 so that a let with no bindings has an array
+  Scope inner = {names, 0, scope};
+  for (int i = 0; i < count; i++, bindings = cdr(bindings)) {
+    Value *binding = car(bindings);
+    names[i] = typeOf(binding) == CONS_TYPE ? car(binding) : NULL_VALUE;
+    if (type == LETREC_NODE && typeOf(names[i]) != SYMBOL_TYPE) {
+      return(errorNode(notSymbol));
+    }
+  }
+  if (type == LETREC_NODE) {
+    inner.count = count;
+  }
+
+  Node *node = newNode(type, count + 1, NULL);
+  bindings = car(args);
+  for (int i = 0; i < count; i++, bindings = cdr(bindings)) {
+    Value *binding = car(bindings);
+    if (typeOf(names[i]) != SYMBOL_TYPE) {
+      node->kids[i] = errorNode(notSymbol);
+    } else if (typeOf(cdr(binding)) != CONS_TYPE) {
+      node->kids[i] = errorNode("let binding has no value\n");
+    } else if (type == LET_NODE) {
+      node->kids[i] = analyzeIn(car(cdr(binding)), scope);
+    } else {
+      if (type == LETSTAR_NODE) {
+        inner.count = i; // the names bound so far
+      }
+      node->kids[i] = analyzeIn(car(cdr(binding)), &inner);
+    }
+  }
+  inner.count = count;
+  node->kids[count] = analyzeIn(car(cdr(args)), &inner);
+  return(node);
+}
+
+// (cond (test expr) ... (else expr)): a clause that isn't two long becomes
+// an error in place of its test, since that is checked when it is reached.
+static Node *analyzeCond(Value *args, Scope *scope)
+{
+  Node *node = newNode(COND_NODE, 2 * length(args), NULL);
+  for (int i = 0; i < node->count; i += 2) {
+    Value *clause = car(args);
+    if (length(clause) != 2) {
+      node->kids[i] = errorNode("conditional clause of improper form\n");
+    } else {
+      node->kids[i] = car(clause) == elseSymbol ? NULL : analyzeIn(car(clause), scope);
+      node->kids[i + 1] = analyzeIn(car(cdr(clause)), scope);
+    }
+    args = cdr(args);
+  }
+  return(node);
+}
+
+static Node *analyzeList(Value *expr, Scope *scope)
+{
+  Value *first = car(expr);
+  Value *args = cdr(expr);
+  Node *node;
+
+  // symbols are interned, so a special form is its symbol
+  if (first == ifSymbol) {
+    if (length(args) != 3) {
+      return(errorNode("more/less than 3 args for if\n"));
+    }
+    return(sequenceNode(IF_NODE, args, 0, NULL, scope));
+  }
+
+  else if (first == letSymbol) {
+    return(analyzeLet(LET_NODE, args, "Let variable not a symbol.\n", scope));
+  }
+
+  else if (first == quoteSymbol) {
+    if (length(args) != 1) {
+      return(errorNode("quote given too many/few arguments\n"));
+    }
+    return(newNode(CONST_NODE, 0, args)); // the argument list, as eval has always returned
+  }
+
+  else if (first == defineSymbol) {
+    if (length(args) != 2) {
+      return(errorNode("Too few/many args for define\n"));
+    }
+    // a name that isn't a symbol can never be looked up, so it isn't bound
+    node = newNode(DEFINE_NODE, 1, typeOf(car(args)) == SYMBOL_TYPE ? globalCell(car(args)) : NULL);
+    node->kids[0] = analyzeIn(car(cdr(args)), scope);
+    return(node);
+  }
+
+  else if (first == lambdaSymbol) {
+    if (length(args) < 2) {
+      return(errorNode("Too few args for lambda\n"));
+    }
+    // a slot for each parameter; only the first body expression is used
+    int count = length(car(args));
+    Value **names = talloc(sizeof(Value *) * (count + 1));
+    Value *param = car(args);
+    for (int i = 0; i < count; i++, param = cdr(param)) {
+      names[i] = car(param);
+    }
+    Scope inner = {names, count, scope};
+    node = newNode(LAMBDA_NODE, 1, car(args));
+    node->slot = count;
+    node->kids[0] = analyzeIn(car(cdr(args)), &inner);
+    return(node);
+  }
+
+  else if (first == letStarSymbol) {
+    return(analyzeLet(LETSTAR_NODE, args, "Let* variable not a symbol.\n", scope));
+  }
+
+  else if (first == letrecSymbol) {
+    return(analyzeLet(LETREC_NODE, args, "Letrec variable not a symbol.\n", scope));
+  }
+
+  else if (first == setSymbol) {
+    if (length(args) != 2) {
+      char *message = talloc(64);
+      snprintf(message, 64, "%i length of set! args\nToo few/many args for set!\n", length(args));
+      return(errorNode(message));
+    }
+    if (typeOf(car(args)) != SYMBOL_TYPE) {
+      return(errorNode("set! not given var to define\n"));
+    }
+    node = newNode(SET_NODE, 1, car(args));
+    if (!resolve(car(args), scope, &node->depth, &node->slot)) {
+      node->depth = -1;
+      node->value = globalCell(car(args));
+    }
+    node->kids[0] = analyzeIn(car(cdr(args)), scope);
+    return(node);
+  }
+
+  else if (first == beginSymbol) {
+    if (length(args) == 0) {
+      return(newNode(CONST_NODE, 0, VOID_VALUE));
+    }
+    return(sequenceNode(BEGIN_NODE, args, 0, NULL, scope));
+  }
+
+  else if (first == condSymbol) {
+    if (length(args) == 0) {
+      return(newNode(CONST_NODE, 0, VOID_VALUE));
+    }
+    return(analyzeCond(args, scope));
+  }
+
+  else if (first == andSymbol) {
+    return(sequenceNode(AND_NODE, args, 0, NULL, scope));
+  }
+
+  else if (first == orSymbol) {
+    return(sequenceNode(OR_NODE, args, 0, NULL, scope));
+  }
+
+  // anything else is a call: the operator, then the arguments
+  node = sequenceNode(CALL_NODE, args, 1, first, scope);
+  node->kids[0] = analyzeIn(first, scope);
+  node->slot = node->kids[0]->type == GLOBAL_NODE;
+  for (int i = 1; i < node->count; i++) {
+    if (!isLeaf(node->kids[i])) {
+      node->slot = 0;
+    }
+  }
+  return(node);
+}
+
+static Node *analyzeIn(Value *expr, Scope *scope)
+{
+  Node *node;
+  checkStack(&node);
+  switch (typeOf(expr)) {
+  case SYMBOL_TYPE:
+    node = newNode(LOCAL_NODE, 0, expr);
+    if (!resolve(expr, scope, &node->depth, &node->slot)) {
+      node->type = GLOBAL_NODE;
+      node->value = globalCell(expr);
+    }
+    return(node);
+  case CONS_TYPE:
+    return(analyzeList(expr, scope));
+  case OPEN_TYPE:
+  case CLOSE_TYPE:
+  case PTR_TYPE:
+    return(errorNode("Unexpected type seen in eval\n"));
+  default: // ints, doubles, strings, booleans and () evaluate to themselves
+    return(newNode(CONST_NODE, 0, expr));
+  }
+}
+
+Node *analyze(Value *expr)
+{
+  return(analyzeIn(expr, NULL)); // a top-level form has no frame
+}
@@ -0,0 +1,70 @@
+#include "value.h"
+
+#ifndef _ANALYZE
+#define _ANALYZE
+
+// The analyzer turns the parse tree of a top-level form into a tree of
+// nodes, once, before the form runs. Which special form a list is, and
+// whether it has the right shape, is decided here, so running the nodes
+// (exec in interpreter.c) only evaluates. A lambda's closure keeps its
+// LAMBDA_NODE, so a body that runs many times is analyzed once.
+//
+// A form with the wrong shape becomes an ERROR_NODE where the check would
+// have failed, which prints the message and stops only when it runs, so
+// errors are reported exactly when and in the order eval used to report
+// them, and not at all in code that never runs.
+//
+// Variables are resolved here too. A name bound by an enclosing lambda, let,
+// let* or letrec becomes a LOCAL_NODE saying where its frame (interpreter.h)
+// is and which slot holds it; any other name is a global, and keeps the
+// name's binding cell (global.h). Each lambda call
+// and each let form makes one frame, with a slot per name in the order
+// written; when a name is bound twice in one form the later one is used.
+typedef enum {CONST_NODE, LOCAL_NODE, GLOBAL_NODE, IF_NODE, LET_NODE, LETSTAR_NODE,
+              LETREC_NODE, LAMBDA_NODE, DEFINE_NODE, SET_NODE, BEGIN_NODE,
+              COND_NODE, AND_NODE, OR_NODE, CALL_NODE, ERROR_NODE} nodeType;
+
+// Nodes live on the collected heap and don't change once built, except that
+// the VM adds its code to a lambda and exec records in spec what it has
+// specialized a call to. What value and kids hold depends on the type:
+//   CONST_NODE   value is the constant (for quote, its list of arguments)
+//   LOCAL_NODE   value is the symbol, found depth frames up in slot
+//   GLOBAL_NODE  value is the binding cell
+//   IF_NODE      kids are the test, then and else
+//   LET_NODE,    kids are the expressions for each slot and then the body.
+//   LETSTAR_NODE   let evaluates the expressions in the enclosing frame; let*
+//   LETREC_NODE    and letrec in the new one, where let* sees only the names
+//                  before each and letrec sees them all
+//   LAMBDA_NODE  value is the parameter list, slot the number of
+//                parameters, kids[0] the body
+//   DEFINE_NODE  value is the binding cell, NULL if the name isn't a
+//                symbol; kids[0] is the expression
+//   SET_NODE     kids[0] is the expression; a local is depth frames up in
+//                slot, a global has a depth of -1 and value is its cell
+//   BEGIN_NODE,  kids are the expressions
+//   AND_NODE,
+//   OR_NODE
+//   COND_NODE    kids are each clause's test and expression in turn; an
+//                else clause has a NULL test
+//   CALL_NODE    value is the operator as written, kids are the operator
+//                and then the arguments; slot is 1 when the operator is a
+//                global and every argument a constant or variable
+//   ERROR_NODE   value is a string of what to print
+typedef struct Node {
+  nodeType type;
+  int count;            // number of kids
+  int depth;            // LOCAL_NODE and SET_NODE: frames up from the current one
+  int slot;
+  int spec;             // CALL_NODE: the types exec has seen it called on (interpreter.c)
+  Value *value;
+  struct Code *code;    // LAMBDA_NODE: its bytecode, once the VM (vm.h) has compiled it
+  struct Node *kids[];
+} Node;
+
+// Interns the names of the special forms; call before analyze.
+void startAnalyzer();
+
+// Returns the node tree for expr.
+Node *analyze(Value *expr);
+
+#endif
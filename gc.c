@@ -0,0 +1,626 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "value.h"
+#include "talloc.h"
+#include "interpreter.h"
+#include "analyze.h"
+#include "vm.h"
+#include "gc.h"
+
+// A generational copying collector for Values, Frames, Nodes and Code.
+//
+// New objects are bump-allocated in the nursery. A minor collection copies
+// whatever is still reachable out of the nursery into the old generation,
+// Cheney style: roots are copied first, then the copies are scanned in order
+// and their children copied after them, so a surviving list ends up laid out
+// contiguously. Old objects that had a young pointer stored into them are
+// recorded by the write barrier and scanned as extra roots. Survivors are
+// promoted on their first collection, so the nursery is empty afterwards and
+// a minor collection costs time proportional to what survived.
+//
+// When the old generation has doubled since the last major collection, a
+// major collection copies every live old object into fresh blocks the same
+// way and recycles the blocks it emptied.
+//
+// Memory comes in blocks taken from talloc (so tfree/texit still release
+// everything), which are kept on a free pool and reused once empty. Each
+// object carries a small header saying what it is and where it lives.
+//
+// On top of that, the interpreter hands back nursery objects it knows are
+// dead (gcRecycle). They are kept on one free list per type and reused
+// before any new nursery space, so a call that doesn't capture its frame
+// allocates nothing on balance. The free lists point into the nursery and are
+// dropped whenever it is emptied.
+//
+// The nursery being bumped is per thread, so the threads of a parallel load
+// (load.c) can build tokens and parse trees side by side. They only share the
+// block pool, which is locked meanwhile, and afterwards the main thread
+// appends their nurseries to its own. Collections only ever happen on the
+// main thread.
+
+#define BLOCK_SIZE        (1 << 19)
+#define NURSERY_SIZE      BLOCK_SIZE
+#define MIN_OLD_THRESHOLD (4 << 20) // old bytes before the first major collection
+#define REGION_MIN        (1 << 16) // allocation a region needs before its end collects
+
+enum {VALUE_OBJECT, FRAME_OBJECT, NODE_OBJECT, CODE_OBJECT};
+
+typedef struct Header {
+  unsigned int size;        // payload bytes
+  unsigned char kind;       // VALUE_OBJECT, FRAME_OBJECT, NODE_OBJECT or CODE_OBJECT
+  unsigned char forwarded;  // copied; the payload's first word is the copy
+  unsigned char generation; // 0 in the nursery, PERMANENT, else the old space's epoch
+  unsigned char remembered; // old object already in the remembered set
+} Header;
+
+#define PERMANENT 0xff // generation of objects from gcAllocPermanent
+
+#define HEADER_SIZE sizeof(Header)
+#define HEADER(obj) ((Header *)((char *)(obj) - HEADER_SIZE))
+
+typedef struct Block {
+  struct Block *next; // next block of the same space, in allocation order
+  char *start;
+  char *bump;
+  char *end;
+} Block;
+
+Block *freeBlocks = NULL;    // empty blocks ready for reuse
+_Thread_local Block *nurseryHead = NULL; // first nursery block, kept across collections
+_Thread_local Block *nurseryTail = NULL; // nursery block being bumped
+Block *oldHead = NULL;
+Block *oldTail = NULL;       // old block promotions are bumped into
+unsigned char epoch = 1;     // generation stamp of the current old space
+int major = 0;               // set while copying the old generation
+
+_Thread_local void *freeValues = NULL; // recycled nursery Values, linked through their first word
+#define RECYCLED_SLOTS 8 // frames with more slots than this aren't recycled
+_Thread_local void *freeFrames[RECYCLED_SLOTS + 1]; // recycled nursery Frames by slots, likewise
+
+void **gcRoots = NULL;
+int gcRootCount = 0;
+int gcRootCapacity = 0;
+
+void ***globals = NULL;
+int globalCount = 0;
+
+#define MAX_STACKS 4
+void ***stackBottoms[MAX_STACKS];
+void ***stackTops[MAX_STACKS];
+void ***stackLows[MAX_STACKS]; // NULL where the whole stack is scanned
+int stackCount = 0;
+int globalCapacity = 0;
+
+void **remembered = NULL;
+int rememberedCount = 0;
+int rememberedCapacity = 0;
+
+_Thread_local size_t gcDebt = 0;
+size_t gcThreshold = NURSERY_SIZE;
+size_t oldBytes = 0;
+size_t oldThreshold = MIN_OLD_THRESHOLD;
+size_t regionOldBytes = 0;   // oldBytes when the current region began
+
+size_t gcHeapLimit = 0;
+size_t usedBytes = 0;        // bytes of blocks not in the free pool, and of stacks
+int overLimit = 0;           // usedBytes passed gcHeapLimit since the last collection
+int collecting = 0;
+
+pthread_mutex_t blockLock = PTHREAD_MUTEX_INITIALIZER;
+int blocksShared = 0;        // other threads are taking blocks too
+
+// statistics
+long minorCollections = 0;
+long majorCollections = 0;
+long recycledObjects = 0;
+double minorPause = 0;
+double majorPause = 0;
+double maxPause = 0;
+size_t promotedBytes = 0;
+size_t heapBytes = 0;
+
+// Grows a talloc'd array of pointers to twice its size (or 64 entries).
+static void **growArray(void **array, int count, int *capacity)
+{
+  int newCapacity = *capacity == 0 ? 64 : *capacity * 2;
+  void **bigger = talloc(sizeof(void *) * newCapacity);
+  if (count > 0) {
+    memcpy(bigger, array, sizeof(void *) * count);
+  }
+  *capacity = newCapacity;
+  return(bigger);
+}
+
+void gcGrowRoots()
+{
+  gcRoots = growArray(gcRoots, gcRootCount, &gcRootCapacity);
+}
+
+void gcAddGlobal(void *slot)
+{
+  if (globalCount == globalCapacity) {
+    globals = (void ***)growArray((void **)globals, globalCount, &globalCapacity);
+  }
+  globals[globalCount++] = slot;
+}
+
+void gcAddStack(void ***bottom, void ***top, void ***low)
+{
+  if (stackCount == MAX_STACKS) {
+    fprintf(stderr, "gc: too many stacks\n");
+    texit(EXIT_FAILURE);
+  }
+  stackBottoms[stackCount] = bottom;
+  stackLows[stackCount] = low;
+  stackTops[stackCount++] = top;
+}
+
+// Counts bytes more of blocks or stacks as in use, checking gcHeapLimit.
+static void addUsedBytes(size_t bytes)
+{
+  usedBytes += bytes;
+  if (gcHeapLimit != 0 && !collecting && usedBytes > gcHeapLimit) {
+    if (usedBytes > 2 * gcHeapLimit) {
+      limitError("heap", (long)gcHeapLimit, EXIT_HEAP_LIMIT);
+    }
+    overLimit = 1;
+    gcDebt = gcThreshold + 1; // collect at the next safepoint
+  }
+}
+
+// Takes an empty block from the pool, or makes a new one. bytes is what
+// it must hold; an object too big for a block gets a new block of just its
+// size, which joins the pool like any other once it's empty.
+static Block *newBlock(size_t bytes)
+{
+  if (blocksShared) {
+    pthread_mutex_lock(&blockLock);
+  }
+  Block *block = freeBlocks;
+  if (block != NULL && bytes <= BLOCK_SIZE) {
+    freeBlocks = block->next;
+  } else {
+    size_t size = bytes > BLOCK_SIZE ? bytes : BLOCK_SIZE;
+    block = talloc(sizeof(Block));
+    block->start = talloc(size);
+    block->end = block->start + size;
+    heapBytes += size;
+  }
+  block->bump = block->start;
+  block->next = NULL;
+
+  addUsedBytes(block->end - block->start);
+  if (blocksShared) {
+    pthread_mutex_unlock(&blockLock);
+  }
+  return(block);
+}
+
+void *gcResizeStack(void *stack, size_t oldBytes, size_t newBytes)
+{
+  void *moved = realloc(stack, newBytes);
+  if (moved == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  if (blocksShared) {
+    pthread_mutex_lock(&blockLock);
+  }
+  heapBytes += newBytes - oldBytes;
+  addUsedBytes(newBytes - oldBytes);
+  if (blocksShared) {
+    pthread_mutex_unlock(&blockLock);
+  }
+  return(moved);
+}
+
+// Returns a chain of blocks to the pool.
+static void releaseBlocks(Block *block)
+{
+  while (block != NULL) {
+    Block *next = block->next;
+#ifdef GC_STRESS
+    memset(block->start, 0xdb, block->end - block->start); // make reads of dead objects fail loudly
+#endif
+    block->next = freeBlocks;
+    freeBlocks = block;
+    usedBytes -= block->end - block->start;
+    block = next;
+  }
+}
+
+// Bumps a header plus size bytes off the tail of a space, adding a block
+// when the tail is full.
+static Header *bumpObject(Block **head, Block **tail, size_t size)
+{
+  if (*tail == NULL || (size_t)((*tail)->end - (*tail)->bump) < HEADER_SIZE + size) {
+    Block *block = newBlock(HEADER_SIZE + size);
+    if (*tail == NULL) {
+      *head = block;
+    } else {
+      (*tail)->next = block;
+    }
+    *tail = block;
+  }
+  Header *header = (Header *)(*tail)->bump;
+  (*tail)->bump += HEADER_SIZE + size;
+  header->size = size;
+  header->forwarded = 0;
+  header->remembered = 0;
+  return(header);
+}
+
+// Objects are allocated in the nursery. Between two safepoints the nursery
+// may run past NURSERY_SIZE (the tokenizer builds the whole program without
+// reaching one); it just takes more blocks until the next minor collection.
+static void *allocObject(int kind, size_t size)
+{
+  Header *header = bumpObject(&nurseryHead, &nurseryTail, size);
+  header->kind = kind;
+  header->generation = 0;
+  void *obj = (char *)header + HEADER_SIZE;
+  memset(obj, 0, size);
+  gcDebt += HEADER_SIZE + size;
+  return(obj);
+}
+
+// Pops an object off a free list, zeroed like a fresh one.
+static void *reuseObject(void **freeList, size_t size)
+{
+  void *obj = *freeList;
+  *freeList = *(void **)obj;
+  memset(obj, 0, size);
+  return(obj);
+}
+
+Value *gcAllocValue()
+{
+  if (freeValues != NULL) {
+    return(reuseObject(&freeValues, sizeof(Value)));
+  }
+  return(allocObject(VALUE_OBJECT, sizeof(Value)));
+}
+
+Value *gcAllocPermanent()
+{
+  Header *header = talloc(HEADER_SIZE + sizeof(Value));
+  memset(header, 0, HEADER_SIZE + sizeof(Value));
+  header->size = sizeof(Value);
+  header->kind = VALUE_OBJECT;
+  header->generation = PERMANENT;
+  return((Value *)((char *)header + HEADER_SIZE));
+}
+
+Frame *gcAllocFrame(int count)
+{
+  size_t size = sizeof(Frame) + sizeof(Value *) * count;
+  Frame *frame;
+  if (count <= RECYCLED_SLOTS && freeFrames[count] != NULL) {
+    frame = reuseObject(&freeFrames[count], size);
+  } else {
+    frame = allocObject(FRAME_OBJECT, size);
+  }
+  frame->count = count;
+  return(frame);
+}
+
+Node *gcAllocNode(int count)
+{
+  return(allocObject(NODE_OBJECT, sizeof(Node) + sizeof(Node *) * count));
+}
+
+Code *gcAllocCode(int constants, int length)
+{
+  return(allocObject(CODE_OBJECT, sizeof(Code) + sizeof(void *) * (constants + length)));
+}
+
+void gcRecycle(void *obj)
+{
+  if (obj == NULL || isImmediate(obj) || HEADER(obj)->generation != 0) {
+    return;
+  }
+  Header *header = HEADER(obj);
+  void **freeList = &freeValues;
+  if (header->kind == FRAME_OBJECT) {
+    int count = ((Frame *)obj)->count;
+    if (count > RECYCLED_SLOTS) {
+      return;
+    }
+    freeList = &freeFrames[count];
+  }
+#ifdef GC_STRESS
+  memset(obj, 0xdb, header->size); // make reads through a stale pointer fail loudly
+#endif
+  *(void **)obj = *freeList;
+  *freeList = obj;
+  recycledObjects++;
+}
+
+void gcWriteBarrier(void *obj)
+{
+  Header *header = HEADER(obj);
+  if (header->generation != 0 && !header->remembered) {
+    header->remembered = 1;
+    if (rememberedCount == rememberedCapacity) {
+      remembered = growArray(remembered, rememberedCount, &rememberedCapacity);
+    }
+    remembered[rememberedCount++] = obj;
+  }
+}
+
+// Copies obj to the end of the old space, unless it is already where this
+// collection wants it, and returns its address afterwards.
+static void *evacuate(void *obj)
+{
+  if (obj == NULL || isImmediate(obj)) {
+    return(obj); // ints, booleans and the empty list aren't on the heap
+  }
+  Header *header = HEADER(obj);
+  if (header->forwarded) {
+    return(*(void **)obj);
+  }
+  // A minor collection leaves every old object alone; a major one copies
+  // the nursery and the previous old space, whose objects are stamped with
+  // the previous epoch. Permanent objects never move.
+  if (header->generation != 0 && (!major || header->generation != 3 - epoch)) {
+    return(obj);
+  }
+  Header *copy = bumpObject(&oldHead, &oldTail, header->size);
+  copy->kind = header->kind;
+  copy->generation = epoch;
+  void *moved = (char *)copy + HEADER_SIZE;
+  memcpy(moved, obj, header->size);
+  oldBytes += HEADER_SIZE + header->size;
+  if (!major) {
+    promotedBytes += HEADER_SIZE + header->size;
+  }
+  header->forwarded = 1;
+  *(void **)obj = moved;
+  return(moved);
+}
+
+// Evacuates everything obj points to and updates its fields.
+static void scanObject(void *obj)
+{
+  if (HEADER(obj)->kind == FRAME_OBJECT) {
+    Frame *frame = obj;
+    frame->parent = evacuate(frame->parent);
+    for (int i = 0; i < frame->count; i++) {
+      frame->slots[i] = evacuate(frame->slots[i]);
+    }
+    return;
+  }
+  if (HEADER(obj)->kind == NODE_OBJECT) {
+    Node *node = obj;
+    node->value = evacuate(node->value);
+    node->code = evacuate(node->code);
+    for (int i = 0; i < node->count; i++) {
+      node->kids[i] = evacuate(node->kids[i]);
+    }
+    return;
+  }
+  if (HEADER(obj)->kind == CODE_OBJECT) {
+    Code *code = obj;
+    for (int i = 0; i < code->constantCount; i++) { // the instructions hold no pointers
+      code->words[i] = evacuate(code->words[i]);
+    }
+    return;
+  }
+  Value *value = obj;
+  switch (value->type) {
+  case CONS_TYPE:
+    value->c.car = evacuate(value->c.car);
+    value->c.cdr = evacuate(value->c.cdr);
+    break;
+  case CLOSURE_TYPE:
+    value->cl.functionCode = evacuate(value->cl.functionCode);
+    value->cl.frame = evacuate(value->cl.frame);
+    break;
+  default: // no heap pointers
+    break;
+  }
+}
+
+static void evacuateRoots()
+{
+  for (int i = 0; i < globalCount; i++) {
+    *globals[i] = evacuate(*globals[i]);
+  }
+  for (int i = 0; i < gcRootCount; i++) {
+    void **slot = gcRoots[i];
+    *slot = evacuate(*slot);
+  }
+  for (int i = 0; i < stackCount; i++) {
+    void **slot = *stackBottoms[i];
+    if (stackLows[i] != NULL) {
+      if (!major) {
+        slot = *stackLows[i]; // nothing below has changed since the last collection
+      }
+      *stackLows[i] = *stackTops[i];
+    }
+    for (; slot < *stackTops[i]; slot++) {
+      *slot = evacuate(*slot);
+    }
+  }
+}
+
+// The Cheney scan: walks the old space from p in block to its end, scanning
+// each copy, which may append more copies for the walk to reach. A NULL block
+// means from the very start.
+static void scanCopies(Block *block, char *p)
+{
+  if (block == NULL) {
+    block = oldHead;
+    p = block == NULL ? NULL : block->start;
+  }
+  while (block != NULL) {
+    while (p < block->bump) {
+      Header *header = (Header *)p;
+      scanObject(p + HEADER_SIZE);
+      p += HEADER_SIZE + header->size;
+    }
+    block = block->next;
+    p = block == NULL ? NULL : block->start;
+  }
+}
+
+// Empties the nursery into the old generation.
+static void minorCollect()
+{
+  Block *scanBlock = oldTail;
+  char *scanStart = oldTail == NULL ? NULL : oldTail->bump;
+
+  evacuateRoots();
+  for (int i = 0; i < rememberedCount; i++) {
+    HEADER(remembered[i])->remembered = 0;
+    scanObject(remembered[i]);
+  }
+  rememberedCount = 0;
+  scanCopies(scanBlock, scanStart);
+
+  releaseBlocks(nurseryHead->next);
+#ifdef GC_STRESS
+  memset(nurseryHead->start, 0xdb, nurseryHead->end - nurseryHead->start);
+#endif
+  nurseryHead->next = NULL;
+  nurseryHead->bump = nurseryHead->start;
+  nurseryTail = nurseryHead;
+  freeValues = NULL;
+  memset(freeFrames, 0, sizeof(freeFrames));
+  gcDebt = 0;
+}
+
+// Copies the live old generation into fresh blocks. The nursery must be
+// empty, which it is right after a minor collection.
+static void majorCollect()
+{
+  Block *fromSpace = oldHead;
+  oldHead = NULL;
+  oldTail = NULL;
+  oldBytes = 0;
+  epoch = 3 - epoch;
+  major = 1;
+
+  evacuateRoots();
+  scanCopies(NULL, NULL);
+
+  major = 0;
+  releaseBlocks(fromSpace);
+  oldThreshold = 2 * oldBytes > MIN_OLD_THRESHOLD ? 2 * oldBytes : MIN_OLD_THRESHOLD;
+}
+
+// Milliseconds since start.
+static double elapsed(struct timespec *start)
+{
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return((end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6);
+}
+
+// Runs a minor collection, followed by a major one if full is set or the old
+// generation has outgrown its threshold.
+static void collect(int full)
+{
+  if (nurseryHead == NULL) {
+    return; // nothing allocated yet
+  }
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  collecting = 1;
+  full = full || overLimit;
+
+  minorCollect();
+  double pause = elapsed(&start);
+  minorCollections++;
+  minorPause += pause;
+
+#ifdef GC_STRESS
+  full = full || minorCollections % 2 == 0;
+#else
+  full = full || oldBytes > oldThreshold;
+#endif
+  if (full) {
+    majorCollect();
+    double total = elapsed(&start);
+    majorCollections++;
+    majorPause += total - pause;
+    pause = total;
+  }
+  if (pause > maxPause) {
+    maxPause = pause;
+  }
+
+  collecting = 0;
+  if (overLimit) {
+    overLimit = 0;
+    if (usedBytes > gcHeapLimit) {
+      limitError("heap", (long)gcHeapLimit, EXIT_HEAP_LIMIT);
+    }
+  }
+}
+
+void gcCollect()
+{
+  collect(0);
+}
+
+void gcBeginRegion()
+{
+  regionOldBytes = oldBytes;
+}
+
+// Whatever the form left in the nursery is released by a minor collection.
+// What it promoted while running is mostly dead as well, so if that grew the
+// old generation by half, the whole heap is collected right away instead of
+// waiting for the old threshold. Regions that allocated very little are left
+// for the next one to pick up.
+void gcEndRegion()
+{
+  size_t grown = oldBytes > regionOldBytes ? oldBytes - regionOldBytes : 0;
+  if (gcDebt < REGION_MIN && grown < REGION_MIN) {
+    return;
+  }
+  collect(grown > MIN_OLD_THRESHOLD / 2 && grown > regionOldBytes / 2);
+}
+
+void gcShare(int on)
+{
+  blocksShared = on;
+}
+
+GcNursery gcTakeNursery()
+{
+  GcNursery nursery = {nurseryHead, nurseryTail, gcDebt};
+  nurseryHead = NULL;
+  nurseryTail = NULL;
+  gcDebt = 0;
+  return(nursery);
+}
+
+void gcAdoptNursery(GcNursery nursery)
+{
+  if (nursery.head == NULL) {
+    return;
+  }
+  if (nurseryTail == NULL) {
+    nurseryHead = nursery.head;
+  } else {
+    nurseryTail->next = nursery.head;
+  }
+  nurseryTail = nursery.tail;
+  gcDebt += nursery.debt;
+}
+
+void gcReport(FILE *out)
+{
+  fprintf(out, "gc: %ld minor collections, %.3f ms total pause, %zu bytes promoted\n",
+          minorCollections, minorPause, promotedBytes);
+  fprintf(out, "gc: %ld major collections, %.3f ms total pause\n",
+          majorCollections, majorPause);
+  fprintf(out, "gc: %.3f ms max pause, %zu bytes old, %zu bytes heap\n",
+          maxPause, oldBytes, heapBytes);
+  fprintf(out, "gc: %ld objects recycled\n", recycledObjects);
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include "value.h"
+
+#ifndef _GC
+#define _GC
+
+struct Frame;
+struct Node;
+
+// Allocate a zeroed Value, or a zeroed Frame with count slots, on the
+// collected heap. Everything the evaluator builds (tokens, parse tree, cons
+// cells, results, frames) lives here; talloc is left for raw bytes such as
+// string buffers, which the collector never looks inside.
+Value *gcAllocValue();
+struct Frame *gcAllocFrame(int count);
+
+// Allocates a zeroed analyzer node (analyze.h) with room for count kids.
+struct Node *gcAllocNode(int count);
+
+// Allocates zeroed bytecode (vm.h) with room for constants constants and
+// length words of instructions.
+struct Code *gcAllocCode(int constants, int length);
+
+// Allocates a zeroed Value that is never moved or freed, and so needs no
+// roots: interned symbols (symbol.h). It mustn't point into the heap, since
+// the collector doesn't scan it.
+Value *gcAllocPermanent();
+
+// Hands back a Value or Frame the caller knows is unreachable, such as the
+// frame of a call that returned without any closure capturing it. It goes on
+// a free list for its type (a frame's, for its number of slots) and is
+// handed out by the next gcAllocValue or gcAllocFrame instead of fresh
+// nursery space. Objects that have already been promoted are ignored and
+// left to the collector.
+void gcRecycle(void *obj);
+
+// The shadow stack of roots. Any function that keeps a Value* or Frame* in a
+// local across a call that can reach eval() has to register the address of
+// that local, and unregister it before returning. The collector keeps what
+// the slot points to alive and rewrites the slot when the object moves, so a
+// pointer that wasn't registered is stale after any eval().
+extern void **gcRoots;
+extern int gcRootCount;
+extern int gcRootCapacity;
+void gcGrowRoots();
+
+static inline void gcPush(void *slot)
+{
+  if (gcRootCount == gcRootCapacity) {
+    gcGrowRoots();
+  }
+  gcRoots[gcRootCount++] = slot;
+}
+
+static inline void gcPop(int count)
+{
+  gcRootCount -= count;
+}
+
+// Registers a global variable (e.g. globalBindings) as a permanent root.
+void gcAddGlobal(void *slot);
+
+// Registers a stack of roots that its owner pushes and pops without telling
+// the collector: every slot from *bottom up to *top is a root. *bottom may
+// change when the stack is moved to grow it. The VM's stack (vm.c) and the
+// tree walker's continuations (interpreter.c) are two.
+// If low isn't NULL, its owner keeps *low at or below every slot it has
+// written since the last collection, which sets *low to *top. The slots
+// below *low still point where that collection left them, in the old
+// generation, so a minor collection scans only from *low up and a deep stack
+// costs each one only what changed.
+void gcAddStack(void ***bottom, void ***top, void ***low);
+
+// Moves a stack of oldBytes to a block of newBytes that starts the same,
+// freeing the old one, and returns it (a NULL stack of 0 bytes makes a new
+// one); the owner moves its own pointers into it. Stacks count against
+// gcHeapLimit with the blocks.
+void *gcResizeStack(void *stack, size_t oldBytes, size_t newBytes);
+
+// Must be called after storing a heap pointer into an object that may have
+// been allocated before the last eval() (and so may already be old), e.g. by
+// set!, letrec or define. Freshly allocated objects don't need it.
+void gcWriteBarrier(void *obj);
+
+// Collects if enough has been allocated since the last collection. Called at
+// the top of exec() (interpreter.c), which is the only place a collection can
+// happen, so code that never runs nodes (tokenizer, parser, analyzer,
+// primitives) needs no roots.
+extern _Thread_local size_t gcDebt;
+extern size_t gcThreshold;
+void gcCollect();
+
+static inline void gcSafepoint()
+{
+#ifdef GC_STRESS
+  gcCollect();
+#else
+  if (gcDebt > gcThreshold) {
+    gcCollect();
+  }
+#endif
+}
+
+// interpret() runs each top-level form in a region of its own. When the form
+// is done, only what the globals and the rest of the program still reach
+// is live, so everything else the form allocated is released in bulk there,
+// rather than whenever the next collection happens to come due.
+void gcBeginRegion();
+void gcEndRegion();
+
+// Upper bound on the collected heap in bytes, 0 for none. Blocks in use and
+// the stacks are checked against it whenever the allocator takes a new block
+// or a stack grows: going over
+// forces a full collection at the next safepoint, and if the live data still
+// doesn't fit, or the heap reaches twice the limit before a safepoint comes,
+// the program stops with EXIT_HEAP_LIMIT.
+extern size_t gcHeapLimit;
+
+// Parallel loading (load.c). Each thread allocates into a nursery of its
+// own; while gcShare is on, taking blocks for one is locked. A loader thread
+// hands its nursery over with gcTakeNursery when it is done, and the main
+// thread appends it to its own with gcAdoptNursery, after which the objects
+// in it are collected like any others.
+typedef struct GcNursery {
+  void *head;
+  void *tail;
+  size_t debt;
+} GcNursery;
+
+void gcShare(int on);
+GcNursery gcTakeNursery();
+void gcAdoptNursery(GcNursery nursery);
+
+// Prints collection counts, pause times and heap size.
+void gcReport(FILE *out);
+
+#endif
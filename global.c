@@ -0,0 +1,68 @@
+#include <stdint.h>
+#include <string.h>
+#include "value.h"
+#include "talloc.h"
+#include "gc.h"
+#include "global.h"
+
+// An open-addressing hash table of binding cells, probed linearly and kept
+// at most half full, like the symbol table. Symbols are interned, so a
+// symbol's address is its identity and the only thing hashed.
+Value **globalCells = NULL;   // NULL for an empty slot
+size_t cellCapacity = 0;
+size_t cellCount = 0;
+
+// Multiplies the address, less the bits alignment leaves zero, by 2^64 over
+// the golden ratio, and folds the well-mixed high half into the low bits the
+// table uses.
+static size_t hashSymbol(Value *symbol)
+{
+  uint64_t hash = ((uint64_t)(uintptr_t)symbol >> 4) * 11400714819323198485ull;
+  return((size_t)(hash ^ (hash >> 32)));
+}
+
+static void growGlobals()
+{
+  size_t capacity = cellCapacity == 0 ? 256 : cellCapacity * 2;
+  Value **bigger = talloc(sizeof(Value *) * capacity);
+  memset(bigger, 0, sizeof(Value *) * capacity);
+  for (size_t i = 0; i < cellCapacity; i++) {
+    if (globalCells[i] != NULL) {
+      size_t j = hashSymbol(globalCells[i]->c.car) & (capacity - 1);
+      while (bigger[j] != NULL) {
+        j = (j + 1) & (capacity - 1);
+      }
+      bigger[j] = globalCells[i];
+    }
+  }
+  globalCells = bigger;
+  cellCapacity = capacity;
+}
+
+Value *globalCell(Value *symbol)
+{
+  if (2 * (cellCount + 1) > cellCapacity) {
+    growGlobals();
+  }
+  size_t i = hashSymbol(symbol) & (cellCapacity - 1);
+  while (globalCells[i] != NULL && globalCells[i]->c.car != symbol) {
+    i = (i + 1) & (cellCapacity - 1);
+  }
+  if (globalCells[i] == NULL) {
+    // the symbol is permanent too, so only the value needs to be a root
+    Value *cell = gcAllocPermanent();
+    cell->type = CONS_TYPE;
+    cell->c.car = symbol;
+    cell->c.cdr = NULL;
+    gcAddGlobal(&cell->c.cdr);
+    countAlloc(SITE_GLOBAL, CONS_TYPE, sizeof(Value));
+    globalCells[i] = cell;
+    cellCount++;
+  }
+  return(globalCells[i]);
+}
+
+void defineGlobal(Value *symbol, Value *val)
+{
+  globalCell(symbol)->c.cdr = val;
+}
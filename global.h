@@ -0,0 +1,17 @@
+#include "value.h"
+
+#ifndef _GLOBAL
+#define _GLOBAL
+
+// The global environment. Each name has one binding cell, a (symbol . value)
+// pair made the first time the name is defined or analyzed as a global, and
+// found through a hash table on the symbol's address. Cells are never moved
+// or freed, so a node can keep its name's cell instead of the name, and a
+// define or set! stores into the cell in place. A cell's value is NULL until
+// its name is defined.
+Value *globalCell(Value *symbol);
+
+// Binds symbol in the global environment, replacing what it was bound to.
+void defineGlobal(Value *symbol, Value *val);
+
+#endif
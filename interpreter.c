@@ -2,937 +2,984 @@
 #include "linkedlist.h"
 #include "tokenizer.h"
 #include "talloc.h"
+#include "gc.h"
 #include "parser.h"
+#include "symbol.h"
+#include "global.h"
+#include "analyze.h"
+#include "vm.h"
 #include "interpreter.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
+#include <sys/resource.h>
 
 // function prototypes
-Value* lookUpSymbol(Value* tree, Frame* frame);
-Value* evalIf      (Value* args, Frame* frame);
-Value* evalLet     (Value* args, Frame* frame);
-void   evalDefine  (Value* args, Frame* frame);
-Value* evalLambda  (Value* args, Frame* frame);
-Value* evalLetStar (Value* args, Frame* frame);
-Value* evalLetRec  (Value* args, Frame* frame);
-void   evalSet     (Value* args, Frame* frame);
-Value* evalBegin   (Value* args, Frame* frame);
-Value* evalCond    (Value* args, Frame* frame);
-Value* evalAnd    (Value* args, Frame* frame);
-Value* evalOr    (Value* args, Frame* frame);
-Value* evalEach    (Value* args, Frame* frame);
-Value* apply       (Value* function, Value* args);
-void bind(char *name, Value *(*function)(struct Value *), Frame *frame);
-Value *primitiveAdd    (Value *args);
-Value *primitiveNull   (Value *args);
-Value *primitiveCar    (Value *args);
-Value *primitiveCdr    (Value *args);
-Value *primitiveCons   (Value *args);
-Value *primitiveTimes  (Value *args);
-Value *primitiveMinus  (Value *args);
-Value *primitiveDivide (Value *args);
-Value *primitiveModulo (Value *args);
-Value *primitiveGreater(Value *args);
-Value *primitiveLess   (Value *args);
-Value *primitiveEqual  (Value *args);
-Value *primitiveLessE  (Value *args);
-Value *primitiveGreaterE(Value *args);
-Value *primitiveEq     (Value *args);
-
-void evaluationError();
-
-Frame* topFrame;
+Value* exec        (Node* node, Frame* frame);
+void   checkLetrecValue(Value* val);
+void   checkSetValue(Value* val);
+void   pushArg     (Value* value);
+Value* leafValue   (Node* node, Frame* frame);
+Value* specializedCall(Node* node, Value* function, Value* a, Value* b);
+Value* addInts     (long x, long y);
+Value* subtractInts(long x, long y);
+void   releaseFrames(Frame* frame, int count);
+void bind(char *name, Value *(*function)(int, struct Value **));
+Value *primitiveAdd    (int argc, Value **argv);
+Value *primitiveNull   (int argc, Value **argv);
+Value *primitiveCar    (int argc, Value **argv);
+Value *primitiveCdr    (int argc, Value **argv);
+Value *primitiveCons   (int argc, Value **argv);
+Value *primitiveTimes  (int argc, Value **argv);
+Value *primitiveMinus  (int argc, Value **argv);
+Value *primitiveDivide (int argc, Value **argv);
+Value *primitiveModulo (int argc, Value **argv);
+Value *primitiveGreater(int argc, Value **argv);
+Value *primitiveLess   (int argc, Value **argv);
+Value *primitiveEqual  (int argc, Value **argv);
+Value *primitiveLessE  (int argc, Value **argv);
+Value *primitiveGreaterE(int argc, Value **argv);
+Value *primitiveEq     (int argc, Value **argv);
+int    compareNumbers(char *op, Value *a, Value *b);
+Value *compareChain(char *op, int accepted, int argc, Value **argv);
+
+
+long maxEvalSteps = LONG_MAX;
+long maxEvalDepth = LONG_MAX;
+long evalSteps = 0;
+long evalDepth = 0;
+
+char* stackBase = NULL; // roughly where interpret's C stack frame is
+size_t stackRoom = 0;   // how far eval may go below it, 0 for no check
+
+// The continuation stack. Instead of running a node's kids with nested
+// calls, exec pushes what is left of the node to do (a continuation) here
+// and runs the kid; when the kid has a value, the continuation on top gets
+// it. So how deeply calls can nest is limited by memory, not by the C stack.
+// Each continuation is K_WORDS words:
+//   the node it belongs to, the frame to go on in, a value it carries (the
+//   let's new frame, the cond's value so far), which kid comes next, how many of the frames
+//   from that frame up were made for the node (owned, see exec), the
+//   profile node, and what kind of continuation it is.
+// The numbers are ints; the stack is registered with the collector.
+enum {K_IF, K_LET, K_LETSTAR, K_LETREC, K_DEFINE, K_SET, K_BEGIN, K_COND_TEST,
+      K_COND_ELSE, K_AND, K_OR, K_CALL};
+
+#define K_WORDS 7
+
+Value** kStack = NULL;
+Value** kEnd = NULL;
+Value** kTop = NULL;
+Value** kLow = NULL; // lowest kTop since the last collection (gc.h)
+
+// The argument stack, where a call's operator and arguments go as they are
+// evaluated, in order, so a primitive gets them in place as its argv and a
+// closure's frame is filled from them. Also registered with the collector.
+Value** aStack = NULL;
+Value** aEnd = NULL;
+Value** aTop = NULL;
+Value** aLow = NULL;
+
+// Calls of these primitives on two constants or variables specialize
+// themselves to the types of the arguments they are first run on: a
+// CALL_NODE's spec is the primitive's ARITH_ number shifted left by 2, or'd
+// with one of the SPEC_ states. A specialized call checks that the global
+// still holds the same primitive and that the arguments still have those
+// types, and does the arithmetic itself. When the check fails, or an int sum
+// or difference leaves the fixnum range, the call goes back to calling the
+// primitive, and stays generic from then on.
+enum {ARITH_ADD, ARITH_MINUS, ARITH_TIMES, ARITH_LESS, ARITH_GREATER,
+      ARITH_LESS_E, ARITH_GREATER_E, ARITH_EQUAL, ARITH_COUNT};
+
+enum {SPEC_UNSEEN, SPEC_INTS, SPEC_DOUBLES, SPEC_GENERIC};
+
+Value *(*arithPrimitives[ARITH_COUNT])(int, Value **) = {
+  primitiveAdd, primitiveMinus, primitiveTimes, primitiveLess, primitiveGreater,
+  primitiveLessE, primitiveGreaterE, primitiveEqual};
+
+// Leaves 256 KB of the C stack's limit as headroom for what runs beyond the
+// last check (printing, primitives, the collector).
+void measureStack(char* base)
+{
+  struct rlimit limit;
+  stackBase = base;
+  if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+      limit.rlim_cur > (1 << 19)) {
+    stackRoom = limit.rlim_cur - (1 << 18);
+  }
+}
+
+void checkStack(void* here)
+{
+  if (stackRoom != 0 && (size_t)(stackBase - (char*)here) > stackRoom) {
+    limitError("C stack", (long)stackRoom, EXIT_DEPTH_LIMIT);
+  }
+}
+
+// Sets up the globals with the primitives, and the special forms.
+void startInterpreter()
+{
+  startAnalyzer();
+
+  kStack = gcResizeStack(NULL, 0, sizeof(Value*) * K_WORDS * 1024);
+  kEnd = kStack + K_WORDS * 1024;
+  kTop = kStack;
+  kLow = kStack;
+  gcAddStack((void ***)&kStack, (void ***)&kTop, (void ***)&kLow);
+  aStack = gcResizeStack(NULL, 0, sizeof(Value*) * 1024);
+  aEnd = aStack + 1024;
+  aTop = aStack;
+  aLow = aStack;
+  gcAddStack((void ***)&aStack, (void ***)&aTop, (void ***)&aLow);
+
+  bind("+"    ,primitiveAdd);
+  bind("null?",primitiveNull);
+  bind("car"  ,primitiveCar);
+  bind("cdr"  ,primitiveCdr);
+  bind("cons" ,primitiveCons);
+  bind("*"    ,primitiveTimes);
+  bind("-"    ,primitiveMinus);
+  bind("/"    ,primitiveDivide);
+  bind("modulo",primitiveModulo);
+  bind(">"    ,primitiveGreater);
+  bind("="    ,primitiveEqual);
+  bind("<"    ,primitiveLess);
+  bind("<="   ,primitiveLessE); //optional
+  bind(">="   ,primitiveGreaterE); //optional
+  bind("eq?"  ,primitiveEq); //optional
+}
+
+// Evaluates a top-level form and prints what it returns.
+void evalTopLevel(Value *form)
+{
+  Value* evaluated_tree = useVM ? vmEval(analyze(form)) : eval(form);
+  printTree(evaluated_tree);
+  // to print the proper spacing
+  if (typeOf(evaluated_tree) != VOID_TYPE) {
+    printf("\n");
+  }
+}
 
 void interpret(Value *tree)
 { // sets up global frame
-  topFrame = talloc(sizeof(Frame));
-  topFrame->parent = NULL;
-  topFrame->bindings = makeNull();
-
-  bind("+"    ,primitiveAdd ,topFrame);
-  bind("null?",primitiveNull,topFrame);
-  bind("car"  ,primitiveCar ,topFrame);
-  bind("cdr"  ,primitiveCdr ,topFrame);
-  bind("cons" ,primitiveCons,topFrame);
-  bind("*"    ,primitiveTimes,topFrame);
-  bind("-"    ,primitiveMinus,topFrame);
-  bind("/"    ,primitiveDivide,topFrame);
-  bind("modulo",primitiveModulo,topFrame);
-  bind(">"    ,primitiveGreater,topFrame);
-  bind("="    ,primitiveEqual,topFrame);
-  bind("<"    ,primitiveLess,topFrame);
-  bind("<="   ,primitiveLessE,topFrame); //optional
-  bind(">="   ,primitiveGreaterE,topFrame); //optional
-  bind("eq?"  ,primitiveEq,topFrame); //optional
+  measureStack((char*)&tree);
+  startInterpreter();
 
   /*
   printInput(tree); // Prints parse tree for comparison //flag
   printf("--> \n");
   */
 
-  Value* evaluated_tree = talloc(sizeof(Value));
+  gcPush(&tree); // the rest of the program must survive collections
   // Increments through and evaluates every S-exp
-  while (tree->type != NULL_TYPE) {
-    evaluated_tree = eval(car(tree), topFrame);
-    printTree(evaluated_tree);
-    // to print the proper spacing
-    if (evaluated_tree->type != VOID_TYPE) {
-      printf("\n");
-    }
+  int form = 0;
+  while (typeOf(tree) != NULL_TYPE) {
+    profilePhase("form", ++form);
+    gcBeginRegion(); // each form's garbage is released once it has printed
+    evalTopLevel(car(tree));
     tree = cdr(tree);
+    gcEndRegion();
   }
+  gcPop(1);
 
   return;
 }
 
-Value *eval(Value *tree, Frame *frame)
-{  // Ints, Doubles, Bools, Nulls, and Strs all evaluate to themselves
-   switch (tree->type)  {
-     case INT_TYPE: {
-        return(tree);
-        break;
-     }
-     case DOUBLE_TYPE: {
-        return(tree);
-        break;
-     }
-     case STR_TYPE: {
-        return(tree);
-        break;
-     }
-     case VOID_TYPE: {
-        printf("???\n");
-        break;
-     }
-     case CLOSURE_TYPE: {
-       printf("!!!\n");
-       break;
-     }
-     case BOOL_TYPE: {
-        return(tree);
-        break;
-     }
-     case NULL_TYPE: {
-        return(tree);
-        break;
-     }
-     case OPEN_TYPE: {
-        printf("Unexpected type seen in eval\n");
-        evaluationError();
-        break;
-     }
-     case CLOSE_TYPE: {
-       printf("Unexpected type seen in eval\n");
-       evaluationError();
-        break;
-     }
-     case PTR_TYPE: {
-       printf("Unexpected type seen in eval\n");
-       evaluationError();
-        break;
-     }
-     case SYMBOL_TYPE: {
-        return lookUpSymbol(tree, frame); // call helper
-        break;
-     }
-     case PRIMITIVE_TYPE: {
-       printf("NOT sure yet\n");
-       break;
-     }
-     case CONS_TYPE: {
-        Value *first = car(tree);
-        Value *args = cdr(tree);
-
-        if (!strcmp(first->s,"if")) {
-            Value* result = evalIf(args,frame); // call helper
-            return(result);
-        }
-
-        else if (!strcmp(first->s,"let")) {
-            Value* result = evalLet(args,frame); // call helper
-            return(result);
-        }
-
-        else if (!strcmp(first->s,"quote")) {
-            if (length(args) == 1) {
-              return(args);
-            } else {
-              printf("quote given too many/few arguments\n");
-              evaluationError();
-            }
-        }
-
-        else if (!strcmp(first->s,"define")) {
-            evalDefine(args, frame); // appends to the topFrame
-            args->type = VOID_TYPE; // to prevent printing
-            return(args);
-        }
-
-        else if (!strcmp(first->s,"lambda")) {
-            Value* result = evalLambda(args,frame); // creates a closure
-            return(result);
-        }
-
-        else if (!strcmp(first->s,"let*")) {
-            Value* result = evalLetStar(args,frame); // call helper
-            return(result);
-        }
-
-        else if (!strcmp(first->s,"letrec")) {
-            Value* result = evalLetRec(args,frame); // call helper
-            return(result);
-        }
-
-        else if (!strcmp(first->s,"set!")) {
-            evalSet(args,frame); // call helper
-            args->type = VOID_TYPE; // to prevent printing
-            return(args);
-        }
-
-        else if (!strcmp(first->s,"begin")) {
-            Value* result = evalBegin(args,frame); // call helper
-            return(result);
-        }
-
-        else if (!strcmp(first->s,"cond")) {
-            Value* result = evalCond(args,frame); // call helper
-            return(result);
-        }
-
-        else if (!strcmp(first->s,"and")) {
-            Value* result = evalAnd(args,frame); // call helper
-            return(result);
-        }
-
-        else if (!strcmp(first->s,"or")) {
-            Value* result = evalOr(args,frame); // call helper
-            return(result);
-        }
-
-        else {
-           // If not a special form, evaluate the first, evaluate the args, then
-           // apply the first to the args.
-           Value *evaledOperator = eval(first, frame); // The closure
-           Value *evaledArgs = evalEach(args, frame);
-           return apply(evaledOperator,evaledArgs);
-        }
-        break;
-    }
-  }
-  return(tree);
-}
-
-
-// recursively check through the frame for the variable name
-Value* lookUpSymbol(Value* tree, Frame* frame)
+void interpretInput()
 {
-  char* symbol = tree->s;
-
-  while (true) { // increment through the frames
-
-    Value* temp_bindings = talloc(sizeof(Value));
-    temp_bindings = frame->bindings;
-
-    while (temp_bindings->type != NULL_TYPE) { // increment through the list of bindings
-      Value* val = talloc(sizeof(Value));
-      char* var = talloc(sizeof(char));
-      Value* var_val = talloc(sizeof(Value));
-
-      var_val = car(temp_bindings);
-      var = car(var_val)->s; // variable name
-      val = cdr(var_val); // value associated with variable
-
-      if (!strcmp(symbol, var)) { // if the symbol is the same as the var
-        tree = val;
-        return(tree); // return the variable's associated value
-      }
-
-      temp_bindings = cdr(temp_bindings);
-    }
-
-    if (frame->parent != NULL) { // Conditional to break from the loop
-      frame = frame->parent;
-    } else {
+  Value *form = NULL;
+  measureStack((char*)&form);
+  startInterpreter();
+  openInput();
+
+  int number = 0;
+  while (true) {
+    profilePhase("form", ++number);
+    gcBeginRegion(); // the form's tokens are garbage too
+    form = readDatum();
+    if (form == NULL) {
+      gcEndRegion();
       break;
     }
-
+    statsPhase = PHASE_EVAL;
+    evalTopLevel(form);
+    gcEndRegion();
   }
-  printf("Variable unassigned.\n"); // If the symbol is never found throw error
-  evaluationError();
-  return(tree);
 }
 
-// eval all bindings with passed in frame
-Value* evalLet(Value* args, Frame* frame)
+// Analyzes tree and runs it, with no frame of its own.
+Value *eval(Value *tree)
 {
-  Frame* new_frame = talloc(sizeof(Frame));
-  new_frame->parent = frame; // parent is the passed in frame.
-
-  Value* bindings = talloc(sizeof(Value));
-  bindings = car(args); // according to let structure
-
-  Value* body = talloc(sizeof(Value));
-  body = car(cdr(args));
-
-  Value* bindingsList = talloc(sizeof(Value));
-  bindingsList = makeNull(); // head of linked list of bindings in the new_frame
-
-  while (bindings->type != NULL_TYPE) {
-
-    Value* val = talloc(sizeof(Value));
-    Value* expr = talloc(sizeof(Value));
-    Value* var = talloc(sizeof(Value));
-    Value* var_val = talloc(sizeof(Value));
-
-    expr = car(cdr(car(bindings))); // that's just what it is
-
-    if (car(car(bindings))->type == SYMBOL_TYPE) {
-      var = car(car(bindings));
-    } else {
-      printf("Let variable not a symbol.\n");
-      evaluationError();
-    }
-
-    val = eval(expr ,frame); // eval using the passed in frame
-
-    var_val = cons(var,val); // car = symbol type, cdr = w/e type
+  return(exec(analyze(tree), NULL));
+}
 
-    bindingsList = cons(var_val, bindingsList); // add on a symbol-value pair to linked list
-    bindings = cdr(bindings);
+void pushContinuation(int kind, Node* node, Frame* frame, Value* carried, int next, int owned)
+{
+  if (kTop + K_WORDS > kEnd) { // grow it
+    size_t used = kTop - kStack;
+    size_t low = kLow - kStack;
+    size_t size = kEnd - kStack;
+    kStack = gcResizeStack(kStack, sizeof(Value*) * size, sizeof(Value*) * 2 * size);
+    kLow = kStack + low;
+    kEnd = kStack + 2 * size;
+    kTop = kStack + used;
   }
-
-  new_frame->bindings = bindingsList;
-
-  Value* tree = talloc(sizeof(Value));
-  tree = eval(body, new_frame);
-
-  return(tree); // return the evaluation of the body given the new_frame
+  if (++evalDepth > maxEvalDepth) {
+    limitError("recursion depth", maxEvalDepth, EXIT_DEPTH_LIMIT);
+  }
+  kTop[0] = (Value*)node;
+  kTop[1] = (Value*)frame;
+  kTop[2] = carried;
+  kTop[3] = makeInt(next);
+  kTop[4] = makeInt(owned);
+  kTop[5] = makeInt((long)profileNode);
+  kTop[6] = makeInt(kind);
+  kTop += K_WORDS;
 }
 
-
-
-// eval all bindings with chain of frames
-Value* evalLetStar (Value* args, Frame* frame)
+void pushArg(Value* value)
 {
-  Value* bindings = talloc(sizeof(Value));
-  bindings = car(args); // according to let* structure
-
-  Value* body = talloc(sizeof(Value));
-  body = car(cdr(args));
-
-  Value* bindingsList = talloc(sizeof(Value));
-  bindingsList = makeNull(); // head of linked list of bindings in the new_frame
-
-  Frame* curr = talloc(sizeof(Frame));
-  curr->parent = frame;
-
-  while (bindings->type != NULL_TYPE) {
-
-    Value* val = talloc(sizeof(Value));
-    Value* expr = talloc(sizeof(Value));
-    Value* var = talloc(sizeof(Value));
-    Value* var_val = talloc(sizeof(Value));
-
-    expr = car(cdr(car(bindings))); // that's just what it is
-
-    if (car(car(bindings))->type == SYMBOL_TYPE) {
-      var = car(car(bindings));
-    } else {
-      printf("Let* variable not a symbol.\n");
-      evaluationError();
-    }
-
-    val = eval(expr,frame); // eval using the passed in frame
-
-    var_val = cons(var,val); // car = symbol type, cdr = w/e type
-
-    bindingsList = cons(var_val, bindingsList); // add on a symbol-value pair to linked list
-    bindings = cdr(bindings);
-
-    curr->bindings = bindingsList;
-    frame = curr; // saves the results in the frame to then evaluate on the next pass through
+  if (aTop == aEnd) {
+    size_t used = aTop - aStack;
+    size_t low = aLow - aStack;
+    aStack = gcResizeStack(aStack, sizeof(Value*) * used, sizeof(Value*) * 2 * used);
+    aLow = aStack + low;
+    aEnd = aStack + 2 * used;
+    aTop = aStack + used;
   }
-
-  Value* tree = talloc(sizeof(Value));
-  tree = eval(body, curr); // evalutes using the last frame in the loop
-
-  return(tree); // return the evaluation of the body given the new_frame
+  *aTop++ = value;
 }
 
-
-// bind to dummy value first in new frame then evaluate later using new frame
-Value* evalLetRec(Value* args, Frame* frame)
+// Runs node in frame. node, frame and the value so far are registered as
+// roots, and a collection may happen before each node runs.
+//
+// A node in tail position (an if's branch, a begin's last expression, a let
+// body, the expression of the cond clause that ends it, a closure's body)
+// takes the place of the node it is in, with no continuation, so a loop
+// written as a tail call runs in constant space. Let bodies and calls also
+// change frame. owned counts the frames made for the node being run, from
+// frame up through its parents; they are released when it has its value or
+// makes a tail call of its own.
+Value *exec(Node *node, Frame *frame)
 {
-  Frame* new_frame = talloc(sizeof(Frame));
-  new_frame->parent = frame; // parent is the passed in frame.
-
-  Value* bindings = talloc(sizeof(Value));
-  bindings = car(args); // according to let structure
-
-  Value* body = talloc(sizeof(Value));
-  body = car(cdr(args));
-
-  Value* bindingsList = talloc(sizeof(Value));
-  bindingsList = makeNull(); // head of linked list of bindings in the new_frame
-
-  while (bindings->type != NULL_TYPE) { // binds the var to a dummy
-    Value* dummy = talloc(sizeof(Value));
-    Value* var = talloc(sizeof(Value));
-    Value* var_dummy = talloc(sizeof(Value));
+  Value* value = NULL;
+  Value* carried = NULL;
+  gcPush(&node);
+  gcPush(&frame);
+  gcPush(&value);
+  gcPush(&carried);
+
+  long base = kTop - kStack; // continuations below here belong to an exec further out
+  ProfileNode *caller = profileNode;
+  int owned = 0;
+  int next = 0;
+  int kind;
+
+run: // node has to be run in frame
+  gcSafepoint();
+  if (++evalSteps > maxEvalSteps) {
+    limitError("step", maxEvalSteps, EXIT_STEP_LIMIT);
+  }
 
-    if (car(car(bindings))->type == SYMBOL_TYPE) {
-      var = car(car(bindings));
-    } else {
-      printf("Letrec variable not a symbol.\n");
-      evaluationError();
+  switch (node->type) {
+    case CONST_NODE:
+    case LOCAL_NODE:
+    case GLOBAL_NODE: {
+       value = leafValue(node, frame);
+       break;
+    }
+    case LAMBDA_NODE: {
+       value = evalLambda(node, frame); // creates a closure
+       break;
+    }
+    case ERROR_NODE: {
+       printf("%s", node->value->s);
+       evaluationError();
+       break;
+    }
+    case IF_NODE:
+       kind = K_IF;
+       goto first;
+    case DEFINE_NODE:
+       kind = K_DEFINE;
+       goto first;
+    case SET_NODE:
+       kind = K_SET;
+       goto first;
+    case CALL_NODE: {
+       kind = K_CALL;
+       carried = NULL; // the operator and arguments go on the argument stack
+       if (node->kids[0]->type != GLOBAL_NODE) {
+         goto first;
+       }
+       // a global operator is read from its binding cell in place, which
+       // define and set! keep current, and a primitive given only constants
+       // and variables is called on them straight away
+       value = lookUpGlobal(node->kids[0]->value);
+       evalSteps++;
+       if (node->slot && typeOf(value) == PRIMITIVE_TYPE) {
+         int argc = node->count - 1;
+         if (argc == 2 && (node->spec & 3) != SPEC_GENERIC) {
+           Value* result = specializedCall(node, value, leafValue(node->kids[1], frame),
+                                           leafValue(node->kids[2], frame));
+           if (result != NULL) {
+             evalSteps += argc;
+             value = result;
+             goto ret;
+           }
+         }
+         for (int i = 1; i <= argc; i++) {
+           pushArg(leafValue(node->kids[i], frame));
+         }
+         evalSteps += argc;
+         Value** argv = aTop - argc;
+         value = apply(value, argc, argv);
+         aTop = argv;
+         if (aTop < aLow) {
+           aLow = aTop;
+         }
+         goto ret;
+       }
+       next = 1;
+       goto operator;
     }
+    case AND_NODE:
+    case OR_NODE: {
+       if (node->count == 0) {
+         value = node->type == AND_NODE ? TRUE_VALUE : FALSE_VALUE;
+         break;
+       }
+       kind = node->type == AND_NODE ? K_AND : K_OR;
+       goto first;
+    }
+    case BEGIN_NODE: {
+       next = 0;
+       goto begin;
+    }
+    case COND_NODE: {
+       next = 0;
+       carried = VOID_VALUE; // the value if no clause ends it
+       goto clause;
+    }
+    case LET_NODE: {
+       // the expressions run in frame, into the slots of the new one
+       Frame* new_frame = newFrame(SITE_LET_FRAME, node->count - 1, frame);
+       if (node->count == 1) {
+         frame = new_frame;
+         owned++;
+         node = node->kids[0];
+         goto run;
+       }
+       kind = K_LET;
+       carried = (Value*)new_frame;
+       goto first;
+    }
+    case LETSTAR_NODE:
+    case LETREC_NODE: {
+       // the expressions run in the new frame; let*'s see only the slots
+       // before theirs, letrec's see them all, as void until filled
+       int count = node->count - 1;
+       frame = newFrame(SITE_LET_FRAME, count, frame);
+       owned++;
+       if (node->type == LETREC_NODE) {
+         for (int i = 0; i < count; i++) {
+           frame->slots[i] = VOID_VALUE;
+         }
+       }
+       if (count == 0) {
+         node = node->kids[0];
+         goto run;
+       }
+       kind = node->type == LETREC_NODE ? K_LETREC : K_LETSTAR;
+       goto first;
+    }
+  }
 
-    var_dummy = cons(var,dummy);
-    bindingsList = cons(var_dummy, bindingsList); // add on a symbol-value pair to linked list
-    bindings = cdr(bindings);
+ret: // value is what node returned
+  releaseFrames(frame, owned);
+  if (kTop == kStack + base) {
+    profileNode = caller;
+    gcPop(4);
+    return(value);
+  }
+  kTop -= K_WORDS;
+  if (kTop < kLow) {
+    kLow = kTop;
   }
-  new_frame->bindings = bindingsList;
-
-  bindings = car(args); // reset the bindings back to the beginning
-
-  Value* temp_bindings = talloc(sizeof(Value));
-  temp_bindings = bindingsList;
-
-  // loops through and replaces the dummys with the actual value
-  while (temp_bindings->type != NULL_TYPE) {
-    Value* expr = talloc(sizeof(Value));
-    Value* val = talloc(sizeof(Value));
-    expr = car(cdr(car(bindings)));
-    val = eval(expr, new_frame); // evals using the bindings with all the var names
-    cdr(car(temp_bindings))->type = val->type;
-    switch (val->type) {
-      case INT_TYPE:
-        cdr(car(temp_bindings))->i = val->i;
-        break;
-      case DOUBLE_TYPE:
-        cdr(car(temp_bindings))->d = val->d;
-        break;
-      case STR_TYPE:
-        cdr(car(temp_bindings))->s = val->s;
-        break;
-      case VOID_TYPE:
-        break;
-      case CLOSURE_TYPE:
-        cdr(car(temp_bindings))->cl = val->cl;
-        break;
-      case BOOL_TYPE:
-        cdr(car(temp_bindings))->cl = val->cl;
-        break;
-      case NULL_TYPE:
-        printf("letrec val error\n");
-        evaluationError();
-      case OPEN_TYPE:
-        printf("letrec val error\n");
-        evaluationError();
-      case CLOSE_TYPE:
-        printf("letrec val error\n");
-        evaluationError();
-      case PTR_TYPE:
-        printf("letrec val error\n");
-        evaluationError();
-      case SYMBOL_TYPE:
-        cdr(car(temp_bindings))->s = val->s;
-        break;
-      case PRIMITIVE_TYPE:
-        printf("letrec val error\n");
-        evaluationError();
-      case CONS_TYPE:
-        printf("letrec val error\n");
-        evaluationError();
+  evalDepth--;
+  node = (Node*)kTop[0];
+  frame = (Frame*)kTop[1];
+  carried = kTop[2];
+  next = intOf(kTop[3]) + 1;
+  owned = intOf(kTop[4]);
+  profileNode = (ProfileNode*)intOf(kTop[5]);
+  kind = intOf(kTop[6]);
+
+  switch (kind) {
+    case K_IF: {
+       long bool_val = intOf(value); // checks the int val on the evaluation of the boolean expression
+       if (bool_val != 0 && bool_val != 1) { // technically doesn't require strict boolean
+         printf("if arg not a boolean.\n"); // 0 and 1 equivalent to #f and #t
+         evaluationError();
+       }
+       node = bool_val ? node->kids[1] : node->kids[2];
+       goto run;
+    }
+    case K_DEFINE: {
+       if (node->value != NULL) {
+         node->value->c.cdr = value; // the name's binding cell, replacing any old value
+       }
+       value = VOID_VALUE; // to prevent printing
+       goto ret;
+    }
+    case K_SET: {
+       if (node->depth < 0) {
+         setGlobal(node->value, value);
+       } else {
+         setLocal(frame, node->depth, node->slot, value);
+       }
+       value = VOID_VALUE; // to prevent printing
+       goto ret;
+    }
+    case K_AND:
+    case K_OR: {
+       long bool_val = intOf(value); // assumes a boolean
+       value = makeBool(bool_val);
+       if (next == node->count || (bool_val != 0) == (kind == K_OR)) { // and stops at #f, or at #t
+         goto ret;
+       }
+       goto more;
+    }
+    case K_BEGIN: {
+       goto begin;
+    }
+    case K_COND_TEST: {
+       if (intOf(value)) { //assumes we're given a boolean
+         node = node->kids[next];
+         goto run;
+       }
+       next++;
+       goto clause;
+    }
+    case K_COND_ELSE: {
+       carried = value; // later clauses may replace it
+       goto clause;
+    }
+    case K_LET:
+    case K_LETSTAR:
+    case K_LETREC: {
+       int count = node->count - 1;
+       Frame* new_frame = kind == K_LET ? (Frame*)carried : frame;
+       if (kind == K_LETREC) {
+         checkLetrecValue(value);
+         new_frame->slots[count - next] = value; // replace the dummy, last name first as always
+       } else {
+         new_frame->slots[next - 1] = value;
+       }
+       gcWriteBarrier(new_frame); // a call in the expression may have promoted it
+       if (next < count) {
+         goto more;
+       }
+       if (kind == K_LET) {
+         frame = new_frame;
+         owned++;
+       }
+       node = node->kids[count];
+       goto run;
+    }
+    case K_CALL: {
+    operator: // value is kid next - 1 of the call
+       pushArg(value);
+       if (next < node->count) {
+         goto more;
+       }
+       int argc = node->count - 1;
+       Value** argv = aTop - argc;
+       Value* function = argv[-1];
+       if (typeOf(function) != CLOSURE_TYPE) {
+         value = apply(function, argc, argv);
+         aTop = argv - 1;
+         if (aTop < aLow) {
+           aLow = aTop;
+         }
+         goto ret;
+       }
+       // a closure's body runs in place of the call
+       Frame* callee = bindArgs(function, argc, argv);
+       aTop = argv - 1;
+       if (aTop < aLow) {
+         aLow = aTop;
+       }
+       if (profileNode != NULL) {
+         // charge the call to the callee, under the function it returns to;
+         // a call in tail position replaces the function making it, so that
+         // is the one that called this one, whose node the continuation on
+         // top (or exec's caller) kept
+         profileNode = kTop == kStack + base ? caller : (ProfileNode*)intOf(kTop[5 - K_WORDS]);
+         profileEnter(typeOf(node->value) == SYMBOL_TYPE ? node->value->s : "lambda");
+       }
+       releaseFrames(frame, owned); // nothing can reach the frames made for the call now
+       frame = callee;
+       owned = 1;
+       node = function->cl.functionCode->kids[0];
+       goto run;
     }
-    temp_bindings = cdr(temp_bindings);
-    bindings = cdr(bindings);
   }
 
-  new_frame->bindings = bindingsList;
-  Value* tree = talloc(sizeof(Value));
-  tree = eval(body, new_frame);
+first: // run the first kid of node, then come back as kind
+  next = 0;
+more: // run kid next of node, then come back as kind
+  pushContinuation(kind, node, frame, carried, next, owned);
+  owned = 0;
+  node = node->kids[next];
+  goto run;
+
+begin: // run kid next of a begin, the last in its place
+  if (next == node->count - 1) {
+    node = node->kids[next];
+    goto run;
+  }
+  kind = K_BEGIN;
+  goto more;
 
-  return(tree); // return the evaluation of the body given the new_frame
+clause: // try the cond clause whose test is kid next, its value so far carried
+  if (next == node->count) {
+    value = carried;
+    goto ret;
+  }
+  if (node->kids[next] == NULL) { // else, which doesn't end the cond unless it's last
+    next++;
+    if (next + 1 == node->count) {
+      node = node->kids[next];
+      goto run;
+    }
+    pushContinuation(K_COND_ELSE, node, frame, carried, next, owned);
+    owned = 0;
+    node = node->kids[next];
+    goto run;
+  }
+  kind = K_COND_TEST;
+  goto more;
 }
 
 
-Value* evalIf(Value* args, Frame* frame)
+// Runs node, a call of the primitive function on a and b, as specialized
+// (see arithPrimitives), specializing it if it hasn't been run yet. Returns
+// NULL if it has to call the primitive instead.
+Value* specializedCall(Node* node, Value* function, Value* a, Value* b)
 {
-  Value* result = talloc(sizeof(Value));
-  if (length(args) == 3) { // checks appropriate length of if statement
-    int bool_val = eval(car(args), frame)->i; // checks the int val on the evaluation of the boolean expression
-
-    if (bool_val != 0 && bool_val != 1) { // technically doesn't require strict boolean
-      printf("if arg not a boolean.\n"); // 0 and 1 equivalent to #f and #t
-      evaluationError();
+  int op = node->spec >> 2;
+  int state = node->spec & 3;
+  if (state == SPEC_UNSEEN) {
+    for (op = 0; op < ARITH_COUNT && arithPrimitives[op] != function->pf; op++) {
     }
-
-    if (bool_val) {
-      result = eval(car(cdr(args)), frame); // eval 2nd arg
+    if (op == ARITH_COUNT || typeOf(a) != typeOf(b)) {
+      state = SPEC_GENERIC;
+    } else if (typeOf(a) == INT_TYPE) {
+      state = SPEC_INTS;
+    } else if (typeOf(a) == DOUBLE_TYPE) {
+      state = SPEC_DOUBLES;
     } else {
-      result = eval(car(cdr(cdr(args))), frame); // eval 3rd arg
+      state = SPEC_GENERIC; // leave the error to the primitive
     }
+    node->spec = op << 2 | state;
+  } else if (arithPrimitives[op] != function->pf || typeOf(a) != typeOf(b) ||
+             typeOf(a) != (state == SPEC_INTS ? INT_TYPE : DOUBLE_TYPE)) {
+    state = SPEC_GENERIC; // deoptimize
+    node->spec = op << 2 | state;
+  }
+  if (state == SPEC_GENERIC) {
+    return(NULL);
+  }
 
+  if (state == SPEC_INTS) {
+    long x = intOf(a);
+    long y = intOf(b);
+    switch (op) {
+      case ARITH_ADD:
+      case ARITH_MINUS: {
+        long result;
+        bool overflow = op == ARITH_ADD ? __builtin_add_overflow(x, y, &result) :
+                                          __builtin_sub_overflow(x, y, &result);
+        if (!overflow && fitsFixnum(result)) {
+          return(makeInt(result));
+        }
+        node->spec = op << 2 | SPEC_GENERIC; // deoptimize; the primitive makes the double
+        return(NULL);
+      }
+      case ARITH_LESS:      return(makeBool(x < y));
+      case ARITH_GREATER:   return(makeBool(x > y));
+      case ARITH_LESS_E:    return(makeBool(x <= y));
+      case ARITH_GREATER_E: return(makeBool(x >= y));
+      case ARITH_EQUAL:     return(makeBool(x == y));
+    }
+  } else if (state == SPEC_DOUBLES) {
+    double x = a->d;
+    double y = b->d;
+    switch (op) {
+      case ARITH_LESS:      return(makeBool(x < y));
+      case ARITH_GREATER:   return(makeBool(x > y));
+      case ARITH_LESS_E:    return(makeBool(x <= y));
+      case ARITH_GREATER_E: return(makeBool(x >= y));
+      case ARITH_EQUAL:     return(makeBool(x == y));
+    }
+  }
+  // * always makes a double, as + and - of doubles do; the double counts
+  // as the primitive's, as under apply
+  statsPhase = PHASE_PRIMITIVE;
+  Value* result;
+  if (state == SPEC_INTS) { // *
+    result = makeDouble((double)intOf(b) * (double)intOf(a));
+  } else if (op == ARITH_ADD) {
+    result = makeDouble(a->d + b->d);
+  } else if (op == ARITH_MINUS) {
+    result = makeDouble(a->d - b->d);
   } else {
-    printf("more/less than 3 args for if\n");
-    evaluationError();
+    result = makeDouble(b->d * a->d);
   }
+  statsPhase = PHASE_EVAL;
   return(result);
 }
 
 
-Value* evalCond(Value* args, Frame* frame)
+// The value of a CONST_NODE, LOCAL_NODE or GLOBAL_NODE in frame.
+Value* leafValue(Node* node, Frame* frame)
 {
-  Value* result = talloc(sizeof(Value));
-  result->type = VOID_TYPE;
-  if (length(args) == 0) {
-    return(result);
+  if (node->type == CONST_NODE) {
+    return(node->value); // ints, doubles, bools, nulls, strs and quoted lists
+  } else if (node->type == LOCAL_NODE) {
+    for (int i = 0; i < node->depth; i++) { // up to the frame that binds it
+      frame = frame->parent;
+    }
+    return(frame->slots[node->slot]);
   }
-  while (args->type != NULL_TYPE) {
-
-    Value* clause =  talloc(sizeof(Value));
-    Value* test =  talloc(sizeof(Value));
-    Value* expr =  talloc(sizeof(Value));
-
-    clause = car(args);
+  return(lookUpGlobal(node->value));
+}
 
-    if (length(clause) != 2) {
-      printf("conditional clause of improper form\n");
-      evaluationError();
-    } else {
-      test = car(clause);
-      expr = car(cdr(clause));
-    }
 
-    if (test->type == SYMBOL_TYPE && !strcmp(test->s,"else")) {
-      result = eval(expr, frame);
-    } else {
-      int bool_val = eval(test, frame)->i; //assumes we're given a boolean
-      if (bool_val) {
-        result = eval(expr, frame);
-        break;
-      }
-    }
-    args = cdr(args);
+// the value in a global's binding cell
+Value* lookUpGlobal(Value* cell)
+{
+  if (cell->c.cdr == NULL) { // never defined
+    printf("Variable unassigned.\n");
+    evaluationError();
   }
-
-  return(result);
+  return(cell->c.cdr);
 }
 
+// A frame of count slots nested in parent, counted against site.
+Frame* newFrame(allocSite site, int count, Frame* parent)
+{
+  Frame* frame = gcAllocFrame(count);
+  countAlloc(site, FRAME_STAT, sizeof(Frame) + sizeof(Value*) * count);
+  frame->parent = parent;
+  return(frame);
+}
 
-Value* evalAnd (Value* args, Frame* frame)
+// letrec can't bind lists or primitives
+void checkLetrecValue(Value* val)
 {
-  Value* result = talloc(sizeof(Value));
-  while (args->type != NULL_TYPE) {
-    Value* test = talloc(sizeof(Value));
-    test = car(args);
-    int bool_val = eval(test,frame)->i; // assumes a boolean
-    result->i = bool_val;
-    result->type = BOOL_TYPE;
-    if (!bool_val) { //bool_val == #f
+  switch (typeOf(val)) {
+    case INT_TYPE:
+    case DOUBLE_TYPE:
+    case STR_TYPE:
+    case VOID_TYPE:
+    case CLOSURE_TYPE:
+    case BOOL_TYPE:
+    case SYMBOL_TYPE:
       break;
-    }
-    args = cdr(args);
+    case NULL_TYPE:
+      printf("letrec val error\n");
+      evaluationError();
+    case OPEN_TYPE:
+      printf("letrec val error\n");
+      evaluationError();
+    case CLOSE_TYPE:
+      printf("letrec val error\n");
+      evaluationError();
+    case PTR_TYPE:
+      printf("letrec val error\n");
+      evaluationError();
+    case PRIMITIVE_TYPE:
+      printf("letrec val error\n");
+      evaluationError();
+    case CONS_TYPE:
+      printf("letrec val error\n");
+      evaluationError();
   }
-  return(result);
 }
 
 
-Value* evalOr (Value* args, Frame* frame)
+// set! can't store lists or primitives
+void checkSetValue(Value* val)
 {
-  Value* result = talloc(sizeof(Value));
-  while (args->type != NULL_TYPE) {
-    Value* test = talloc(sizeof(Value));
-    test = car(args);
-    int bool_val = eval(test,frame)->i; // assumes a boolean
-    result->i = bool_val;
-    result->type = BOOL_TYPE;
-    if (bool_val) { //bool_val == #t
+  switch (typeOf(val)) {
+    case INT_TYPE:
+    case DOUBLE_TYPE:
+    case STR_TYPE:
+    case VOID_TYPE:
+    case CLOSURE_TYPE:
+    case BOOL_TYPE:
+    case SYMBOL_TYPE:
       break;
-    }
-    args = cdr(args);
+    case NULL_TYPE:
+      printf("set! val error\n");
+      evaluationError();
+    case OPEN_TYPE:
+      printf("set! val error\n");
+      evaluationError();
+    case CLOSE_TYPE:
+      printf("set! val error\n");
+      evaluationError();
+    case PTR_TYPE:
+      printf("set! val error\n");
+      evaluationError();
+    case PRIMITIVE_TYPE:
+      printf("set! val error\n");
+      evaluationError();
+    case CONS_TYPE:
+      printf("set! val error\n");
+      evaluationError();
   }
-  return(result);
 }
 
 
-void evalDefine(Value* args, Frame* frame)
+void setLocal(Frame* frame, int depth, int slot, Value* val)
 {
-  if (length(args) != 2) {
-    printf("Too few/many args for define\n");
-    evaluationError();
-  } else {
-    Value* var = talloc(sizeof(Value));
-    Value* val = talloc(sizeof(Value));
-    Value* var_val = talloc(sizeof(Value));
-
-    var = car(args); // name of the thing being defined
-    val = eval(car(cdr(args)), frame); // value associated to the name
-
-    var_val = cons(var,val);
-    topFrame->bindings = cons(var_val, topFrame->bindings);
+  checkSetValue(val);
+  for (int i = 0; i < depth; i++) {
+    frame = frame->parent;
   }
-  return;
+  frame->slots[slot] = val; // rebind in place
+  gcWriteBarrier(frame);
 }
 
 
-void evalSet (Value* args, Frame* frame)
+void setGlobal(Value* cell, Value* val)
 {
-  if (length(args) != 2) {
-    printf("%i length of set! args\n", length(args));
-    printf("Too few/many args for set!\n");
+  if (cell->c.cdr == NULL) { // never defined
+    printf("Set cannot find variable.\n");
     evaluationError();
-  } else {
-    char* symbol = talloc(sizeof(Value));
-    Value* val = talloc(sizeof(Value));
-    Value* var_val = talloc(sizeof(Value));
-
-    if (car(args)->type == SYMBOL_TYPE) {
-      symbol = car(args)->s; // name of the thing being set!
-    } else {
-      printf("set! not given var to define\n");
-      evaluationError();
-    }
-
-    val = eval(car(cdr(args)), frame); // value we're trying to bind
-
-    int flag = 1;
-    while (flag) { // increment through the frames
-
-      Value* temp_bindings = talloc(sizeof(Value));
-      temp_bindings = frame->bindings;
-
-      while (temp_bindings->type != NULL_TYPE) { // increment through the list of bindings
-        char* var = talloc(sizeof(char));
-        Value* var_val = talloc(sizeof(Value));
-
-        var_val = car(temp_bindings);
-        var = car(var_val)->s; // variable name
-
-        if (!strcmp(symbol, var)) { // if the symbol is the same as the var
-          cdr(var_val)->type = val->type;
-          switch (val->type) {
-            case INT_TYPE:
-              cdr(car(temp_bindings))->i = val->i;
-              break;
-            case DOUBLE_TYPE:
-              cdr(car(temp_bindings))->d = val->d;
-              break;
-            case STR_TYPE:
-              cdr(car(temp_bindings))->s = val->s;
-              break;
-            case VOID_TYPE:
-              break;
-            case CLOSURE_TYPE:
-              cdr(car(temp_bindings))->cl = val->cl;
-              break;
-            case BOOL_TYPE:
-              cdr(car(temp_bindings))->i = val->i;
-              break;
-            case NULL_TYPE:
-              printf("set! val error\n");
-              evaluationError();
-            case OPEN_TYPE:
-              printf("set! val error\n");
-              evaluationError();
-            case CLOSE_TYPE:
-              printf("set! val error\n");
-              evaluationError();
-            case PTR_TYPE:
-              printf("set! val error\n");
-              evaluationError();
-            case SYMBOL_TYPE:
-              cdr(car(temp_bindings))->s = val->s;
-              break;
-            case PRIMITIVE_TYPE:
-              printf("set! val error\n");
-              evaluationError();
-            case CONS_TYPE:
-              printf("set! val error\n");
-              evaluationError();
-          }
-          flag = 0;
-          break;
-        }
-        temp_bindings = cdr(temp_bindings);
-      }
-      if (flag == 0) {
-        break;
-      }
-      if (frame->parent != NULL) { // Conditional to break from the loop
-        frame = frame->parent;
-      } else {
-        printf("Set cannot find variable.\n"); // If the symbol is never found throw error
-        evaluationError();
-      }
-    }
   }
-  return;
+  checkSetValue(val);
+  cell->c.cdr = val; // rebind in place; cells are roots, so no barrier
 }
 
 
-Value* evalLambda(Value* args, Frame* frame)
+Value* evalLambda(Node* node, Frame* frame)
 {
-  Value* closure = talloc(sizeof(Value));
+  Value* closure = gcAllocValue();
   closure->type = CLOSURE_TYPE;
+  countAlloc(SITE_CLOSURE, CLOSURE_TYPE, sizeof(Value));
 
-  if (length(args) < 2) {
-    printf("Too few args for lambda\n");
-    evaluationError();
-  } else {
-    Value* params = talloc(sizeof(Value));
-    Value* body = talloc(sizeof(Value));
-
-    params = car(args);
-    body = car(cdr(args)); // assumes single body lambda which reduces some functionality
-
-    //body = makeNull(); //would have to be used in multi-body lambda
-    //body = cons(cdr(args),body);
+  closure->cl.functionCode = node; // the body is its only kid
+  closure->cl.frame = frame;
 
-    closure->cl.paramNames = params;
-    closure->cl.functionCode = body;
-    closure->cl.frame = frame;
+  // the frame and everything it chains to must now outlive their calls
+  for (Frame* curr = frame; curr != NULL && !curr->captured; curr = curr->parent) {
+    curr->captured = 1;
   }
   return(closure);
 }
 
 
-Value* evalBegin(Value* args, Frame* frame) //make changes to let and lambda flag
+// The frame for a call of a closure, with a slot for each argument.
+Frame* bindArgs(Value* function, int argc, Value** argv)
 {
-  Value* result = talloc(sizeof(Value));
-
-  if (length(args) == 0) {
-    result->type = VOID_TYPE;
-    return(result);
+  if (argc != function->cl.functionCode->slot) { // its number of parameters
+    printf("# of requested params != # of passed in args\n");
+    evaluationError();
   }
 
-  while (args->type != NULL_TYPE) {
-    result = eval(car(args), frame);
-    args = cdr(args);
-  }
-  return(result);
+  Frame* frame = newFrame(SITE_APPLY_FRAME, argc, function->cl.frame);
+  memcpy(frame->slots, argv, sizeof(Value*) * argc); //args pre-evaluated already
+  return(frame);
 }
 
 
-Value* evalEach(Value* args, Frame* frame)
+// Closures are never applied here: exec and the VM run their bodies in place,
+// on their own stacks, so the C stack doesn't grow with the call depth.
+Value* apply (Value* function, int argc, Value** argv)
 {
-  Value* tree = makeNull();
-  while (args->type != NULL_TYPE) {
-    Value* val = talloc(sizeof(Value));
-    val = eval(car(args), frame);
-    args = cdr(args);
-    tree = cons(val, tree);
-  }
-  return(reverse(tree));
+  statsPhase = PHASE_PRIMITIVE; // what it allocates is its result
+  Value* result = (function->pf)(argc, argv);
+  statsPhase = PHASE_EVAL;
+  return(result);
 }
 
 
-Value* apply (Value* function, Value* args)
+// Recycles a let or call frame once its body has returned. Only closures
+// keep frames alive past that, so an uncaptured frame is garbage; the values
+// it bound may not be, and are left alone.
+void releaseFrame(Frame* frame)
 {
-  if (function->type == CLOSURE_TYPE) {
-
-    if (length(args) != length(function->cl.paramNames)) {
-      printf("# of requested params != # of passed in args\n");
-      evaluationError();
-    }
-
-    Frame* frame = talloc(sizeof(Frame));
-    frame->parent = function->cl.frame;
-    Value* curr = talloc(sizeof(Value));
-    curr = function->cl.paramNames;
-    frame->bindings = makeNull();
-
-    while ((curr)->type != NULL_TYPE) {
-      Value* binding = talloc(sizeof(Value));
-      binding = cons(car(curr), car(args)); //args pre-evaluated already
-      frame->bindings = cons(binding, frame->bindings);
-      curr = cdr(curr);
-      args = cdr(args);
-    }
-
-    Value* tree = talloc(sizeof(Value));
-
-    /*
-    // allows multi-body lambda's however I couldn't get the frame chaining working
-    tree = makeNull();
-    Value* tempCode = talloc(sizeof(Value));
-    tempCode = function->cl.functionCode;
-    while (tempCode != NULL) {
-      tree = cons(eval(car(tempCode), frame), tree);
-      //tree = eval(car(tempCode),frame);
-      tempCode = cdr(tempCode);
-    }
-    */
+  if (!frame->captured) {
+    gcRecycle(frame);
+  }
+}
 
-    tree = eval(function->cl.functionCode, frame);
-    return(tree);
 
-  } else {
-    return((function->pf)(args));
+// Releases count frames: frame and the parents above it.
+void releaseFrames(Frame* frame, int count)
+{
+  for (int i = 0; i < count; i++) {
+    Frame* parent = frame->parent; // before recycling clobbers it
+    releaseFrame(frame);
+    frame = parent;
   }
 }
 
 
-void bind(char *name, Value *(*function)(struct Value *), Frame *frame) {
+void bind(char *name, Value *(*function)(int, struct Value **)) {
     // Add primitive functions to top-level bindings list
-    Value *value = talloc(sizeof(Value));
-    Value* var_val = talloc(sizeof(Value));
-    Value* wrapper = talloc(sizeof(Value));
+    Value *value = gcAllocValue();
 
     value->type = PRIMITIVE_TYPE;
     value->pf = function;
+    countAlloc(SITE_GLOBAL, PRIMITIVE_TYPE, sizeof(Value));
 
-    wrapper->type = SYMBOL_TYPE;
-    wrapper->s = name;
+    defineGlobal(intern(name), value);
+}
 
-    var_val = cons(wrapper, value);
 
-    frame->bindings = cons(var_val, frame->bindings);
+// x + y and x - y of two fixnums, or the nearest double when that is past the
+// fixnum range, as a literal that size reads as.
+Value *addInts(long x, long y)
+{
+  long sum;
+  if (__builtin_add_overflow(x, y, &sum)) {
+    return(makeDouble((double)x + (double)y));
+  }
+  return(fitsFixnum(sum) ? makeInt(sum) : makeDouble((double)sum));
 }
 
+Value *subtractInts(long x, long y)
+{
+  long difference;
+  if (__builtin_sub_overflow(x, y, &difference)) {
+    return(makeDouble((double)x - (double)y));
+  }
+  return(fitsFixnum(difference) ? makeInt(difference) : makeDouble((double)difference));
+}
 
-Value *primitiveAdd(Value *args)
+// Adds any number of numbers; the sum stays an int until a double joins it,
+// or it leaves the fixnum range.
+// A double that comes first starts the sum itself rather than being added
+// to 0, which would turn -0.0 into 0.0.
+Value *primitiveAdd(int argc, Value **argv)
 {
-   // check that args has length 2 and car(args), car(cdr(args)) args are numerical
-   if (length(args) == 2) {
-     Value* result = talloc(sizeof(Value));
-     int int1;
-     int int2;
-     int intsum;
-     double d1;
-     double d2;
-     double dsum;
-
-     if (car(args)->type == INT_TYPE && car(cdr(args))->type == INT_TYPE) {
-       int1 = car(args)->i;
-       int2 = car(cdr(args))->i;
-       intsum = int1 + int2;
-       result->type = INT_TYPE;
-       result->i =  intsum;
-       return (result);
-     } else if (car(args)->type == INT_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-         int1 = car(args)->i;
-         d2 = car(cdr(args))->d;
-         dsum = int1 + d2;
-         result->type = DOUBLE_TYPE;
-         result->d = dsum;
-         return (result);
-     } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == INT_TYPE) {
-         d1 = car(args)->d;
-         int2 = car(cdr(args))->i;
-         dsum = d1 + int2;
-         result->type = DOUBLE_TYPE;
-         result->d = dsum;
-         return (result);
-     } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-         d1 = car(args)->d;
-         d2 = car(cdr(args))->d;
-         dsum = d1 + d2;
-         result->type = DOUBLE_TYPE;
-         result->d = dsum;
-         return(result);
-     } else {
-       printf("+ function not given numbers\n");
-       evaluationError();
-     }
-   } else {
-     printf("+ function not given 2 arguments to add\n");
-     evaluationError();
-   }
-   return(args); //error if this step is reached
+  long intsum = 0;
+  double dsum = 0;
+  bool isDouble = false;
+  for (int i = 0; i < argc; i++) {
+    if (typeOf(argv[i]) == INT_TYPE) {
+      if (isDouble) {
+        dsum = dsum + intOf(argv[i]);
+      } else {
+        Value* sum = addInts(intsum, intOf(argv[i]));
+        if (typeOf(sum) == INT_TYPE) {
+          intsum = intOf(sum);
+        } else {
+          dsum = sum->d;
+          isDouble = true;
+        }
+      }
+    } else if (typeOf(argv[i]) == DOUBLE_TYPE) {
+      if (!isDouble) {
+        dsum = i == 0 ? argv[i]->d : intsum + argv[i]->d;
+        isDouble = true;
+      } else {
+        dsum = dsum + argv[i]->d;
+      }
+    } else {
+      printf("+ function not given numbers\n");
+      evaluationError();
+    }
+  }
+  if (isDouble) {
+    return(makeDouble(dsum));
+  }
+  return(makeInt(intsum));
 }
 
-Value *primitiveNull(Value *args)
+Value *primitiveNull(int argc, Value **argv)
 {
-  if (args->type != CONS_TYPE) {
+  if (argc == 0) {
     printf("null? not passed a list\n");
     evaluationError();
-  } else {
-    Value* result = talloc(sizeof(Value));
-    result->type = BOOL_TYPE;
-    while (args->type == CONS_TYPE){
-      if ((car(args)->type == NULL_TYPE && length(args) == 1) || (car(car(args))->type == NULL_TYPE && length(args) == 1)) { //null? should return true
-        result->i = 1;
-        return(result);
-      }
-      args = cdr(args);
-    }
-    result->i = 0;
-    return(result);
   }
-  return(args); //error if this step is reached
+  Value* arg = argv[argc - 1]; // only the last argument is looked at
+  if (typeOf(arg) == NULL_TYPE || (typeOf(arg) == CONS_TYPE && typeOf(car(arg)) == NULL_TYPE)) { //null? should return true
+    return(TRUE_VALUE);
+  }
+  return(FALSE_VALUE);
 }
 
 
-Value *primitiveCar(Value *args)
+Value *primitiveCar(int argc, Value **argv)
 {
-  if (args->type == CONS_TYPE) {
-    if (car(args)->type == CONS_TYPE) {
-      if (car(car(args))->type == CONS_TYPE && car(car(car(args)))->type != CONS_TYPE) {
-          return(car(car(car(args))));
-      } else if (car(car(args))->type == CONS_TYPE && car(car(car(args)))->type == CONS_TYPE) {
-        Value *wrapper = talloc(sizeof(Value));
-        wrapper = makeNull();
-        wrapper = cons(car(car(car(args))), wrapper);
+  if (argc > 0) {
+    Value* list = argv[0];
+    if (typeOf(list) == CONS_TYPE) {
+      if (typeOf(car(list)) == CONS_TYPE && typeOf(car(car(list))) != CONS_TYPE) {
+          return(car(car(list)));
+      } else if (typeOf(car(list)) == CONS_TYPE && typeOf(car(car(list))) == CONS_TYPE) {
+        Value *wrapper = makeNull();
+        wrapper = cons(car(car(list)), wrapper);
         return(wrapper);
       }
     }
   }
   printf("car args not a list/ is a null list\n");
   evaluationError();
-  return(args); //error if this step is reached
+  return(NULL); //error if this step is reached
 }
 
 
-Value *primitiveCdr(Value *args)
+Value *primitiveCdr(int argc, Value **argv)
 {
-  if (args->type == CONS_TYPE) {
-    if (car(args)->type == CONS_TYPE && car(car(args))->type != NULL_TYPE) {
-      if (car(car(args))->type == CONS_TYPE && cdr(car(car(args)))->type != CONS_TYPE) {
-        return(cdr(car(car(args))));
-      } else if (car(car(args))->type == CONS_TYPE && cdr(car(car(args)))->type == CONS_TYPE) {
-        Value *wrapper = talloc(sizeof(Value));
-        wrapper = makeNull();
-        wrapper = cons(cdr(car(car(args))), wrapper);
+  if (argc > 0) {
+    Value* list = argv[0];
+    if (typeOf(list) == CONS_TYPE && typeOf(car(list)) != NULL_TYPE) {
+      if (typeOf(car(list)) == CONS_TYPE && typeOf(cdr(car(list))) != CONS_TYPE) {
+        return(cdr(car(list)));
+      } else if (typeOf(car(list)) == CONS_TYPE && typeOf(cdr(car(list))) == CONS_TYPE) {
+        Value *wrapper = makeNull();
+        wrapper = cons(cdr(car(list)), wrapper);
         return(wrapper);
       } else {
-        Value* null = talloc(sizeof(Value));
-        null->type = NULL_TYPE;
-        return(null);
+        return(makeNull());
       }
     }
   }
   printf("cdr args not a list/ is a null list\n");
   evaluationError();
-  return(args); //error if this step is reached
+  return(NULL); //error if this step is reached
 }
 
 
-Value *primitiveCons(Value *args)
+Value *primitiveCons(int argc, Value **argv)
 {
-  if (length(args) == 2) {
-    Value* consCell = talloc(sizeof(Value));
-    Value* wrapper  = talloc(sizeof(Value));
-    Value* a = car(args);
-    Value* b = car(cdr(args));
+  if (argc == 2) {
+    Value* a = argv[0];
+    Value* b = argv[1];
 
     //remove useless layers
-    while (a->type == CONS_TYPE && cdr(a)->type == NULL_TYPE) {
+    while (typeOf(a) == CONS_TYPE && typeOf(cdr(a)) == NULL_TYPE) {
       a = car(a);
     }
-    while (b->type == CONS_TYPE && cdr(b)->type == NULL_TYPE) {
+    while (typeOf(b) == CONS_TYPE && typeOf(cdr(b)) == NULL_TYPE) {
       b = car(b);
     }
 
-    wrapper = makeNull();
-    consCell = makeNull();
-    if (b->type != NULL_TYPE) {
+    Value* wrapper = makeNull();
+    Value* consCell = makeNull();
+    if (typeOf(b) != NULL_TYPE) {
       consCell = cons(b, consCell);
     }
-    if (a->type != NULL_TYPE) {
+    if (typeOf(a) != NULL_TYPE) {
       consCell = cons(a, consCell);
     }
     consCell = cons(consCell, wrapper);
@@ -942,70 +989,40 @@ Value *primitiveCons(Value *args)
     printf("Given more/less than 2 arguments for cons\n");
     evaluationError();
   }
-  return(args); //error if this step is reached
+  return(NULL); //error if this step is reached
 }
 
 
-Value *primitiveTimes(Value *args)
+Value *primitiveTimes(int argc, Value **argv)
 {
   double product = 1;
-  Value* result = talloc(sizeof(Value));
-  result->type = DOUBLE_TYPE;
-  while (args->type != NULL_TYPE) {
-    if (car(args)->type == INT_TYPE) {
-      product = (double)car(args)->i * product;
-    } else if (car(args)->type == DOUBLE_TYPE) {
-      product = car(args)->d * product;
+  for (int i = 0; i < argc; i++) {
+    if (typeOf(argv[i]) == INT_TYPE) {
+      product = (double)intOf(argv[i]) * product;
+    } else if (typeOf(argv[i]) == DOUBLE_TYPE) {
+      product = argv[i]->d * product;
     } else {
       printf("* given non number input\n");
       evaluationError();
     }
-    args = cdr(args);
   }
-  result->d = product;
-  return(result);
+  return(makeDouble(product));
 }
 
-Value *primitiveMinus(Value *args)
+Value *primitiveMinus(int argc, Value **argv)
 {
-// check that args has length 2 and car(args), car(cdr(args)) args are numerical
-if (length(args) == 2) {
-  Value* result = talloc(sizeof(Value));
-  int int1;
-  int int2;
-  int intsum;
-  double d1;
-  double d2;
-  double dsum;
-
-    if (car(args)->type == INT_TYPE && car(cdr(args))->type == INT_TYPE) {
-      int1 = car(args)->i;
-      int2 = car(cdr(args))->i;
-      intsum = int1 - int2;
-      result->type = INT_TYPE;
-      result->i =  intsum;
-      return (result);
-    } else if (car(args)->type == INT_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        int1 = car(args)->i;
-        d2 = car(cdr(args))->d;
-        dsum = int1 - d2;
-        result->type = DOUBLE_TYPE;
-        result->d = dsum;
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == INT_TYPE) {
-        d1 = car(args)->d;
-        int2 = car(cdr(args))->i;
-        dsum = d1 - int2;
-        result->type = DOUBLE_TYPE;
-        result->d = dsum;
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        d1 = car(args)->d;
-        d2 = car(cdr(args))->d;
-        dsum = d1 - d2;
-        result->type = DOUBLE_TYPE;
-        result->d = dsum;
-        return(result);
+  // check that there are 2 args and both are numerical
+  if (argc == 2) {
+    Value* a = argv[0];
+    Value* b = argv[1];
+    if (typeOf(a) == INT_TYPE && typeOf(b) == INT_TYPE) {
+      return(subtractInts(intOf(a), intOf(b)));
+    } else if (typeOf(a) == INT_TYPE && typeOf(b) == DOUBLE_TYPE) {
+      return(makeDouble(intOf(a) - b->d));
+    } else if (typeOf(a) == DOUBLE_TYPE && typeOf(b) == INT_TYPE) {
+      return(makeDouble(a->d - intOf(b)));
+    } else if (typeOf(a) == DOUBLE_TYPE && typeOf(b) == DOUBLE_TYPE) {
+      return(makeDouble(a->d - b->d));
     } else {
       printf("- function not given numbers\n");
       evaluationError();
@@ -1014,39 +1031,31 @@ if (length(args) == 2) {
     printf("- function not given 2 arguments to subtract\n");
     evaluationError();
   }
-  return(args); //error if this step is reached
+  return(NULL); //error if this step is reached
 }
 
 
-Value *primitiveDivide(Value *args)
+Value *primitiveDivide(int argc, Value **argv)
 {
-  if (length(args) == 2) {
-    Value* result = talloc(sizeof(Value));
-    if (car(cdr(args))->i == 0) {
+  if (argc == 2) {
+    Value* a = argv[0];
+    Value* b = argv[1];
+    if (intOf(b) == 0) {
       printf("Don't divide by 0\n");
       evaluationError();
     }
-    if (car(args)->type == INT_TYPE && car(cdr(args))->type == INT_TYPE) {
-      if ((car(args)->i % car(cdr(args))->i) == 0) { //checks for even division
-        result->i = car(args)->i / car(cdr(args))->i;
-        result->type = INT_TYPE;
-      } else {
-        result->d = car(args)->i / (double)car(cdr(args))->i;
-        result->type = DOUBLE_TYPE;
+    if (typeOf(a) == INT_TYPE && typeOf(b) == INT_TYPE) {
+      if ((intOf(a) % intOf(b)) == 0) { //checks for even division
+        long quotient = intOf(a) / intOf(b); // only FIXNUM_MIN / -1 leaves the range
+        return(fitsFixnum(quotient) ? makeInt(quotient) : makeDouble((double)quotient));
       }
-      return(result);
-    } else if (car(args)->type == INT_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-      result->d = car(args)->i / car(cdr(args))->d;
-      result->type = DOUBLE_TYPE;
-      return(result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == INT_TYPE) {
-      result->d = car(args)->d / car(cdr(args))->i;
-      result->type = DOUBLE_TYPE;
-      return(result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-      result->d = car(args)->d / car(cdr(args))->d;
-      result->type = DOUBLE_TYPE;
-      return(result);
+      return(makeDouble(intOf(a) / (double)intOf(b)));
+    } else if (typeOf(a) == INT_TYPE && typeOf(b) == DOUBLE_TYPE) {
+      return(makeDouble(intOf(a) / b->d));
+    } else if (typeOf(a) == DOUBLE_TYPE && typeOf(b) == INT_TYPE) {
+      return(makeDouble(a->d / intOf(b)));
+    } else if (typeOf(a) == DOUBLE_TYPE && typeOf(b) == DOUBLE_TYPE) {
+      return(makeDouble(a->d / b->d));
     } else {
       printf("divide function not given numbers\n");
       evaluationError();
@@ -1055,21 +1064,19 @@ Value *primitiveDivide(Value *args)
     printf("too many/few args for divide \n");
     evaluationError();
   }
-  return(args);
+  return(NULL);
 }
 
 
-Value *primitiveModulo(Value *args)
+Value *primitiveModulo(int argc, Value **argv)
 {
-  if (length(args) == 2) {
-    if (car(args)->type == INT_TYPE && car(cdr(args))->type == INT_TYPE) {
-      Value* result = talloc(sizeof(Value));
-      result->type = INT_TYPE;
-      result->i = car(args)->i % car(cdr(args))->i;
-      if (result->i < 0) {
-        result->i = result->i + car(cdr(args))->i;
+  if (argc == 2) {
+    if (typeOf(argv[0]) == INT_TYPE && typeOf(argv[1]) == INT_TYPE) {
+      long remainder = intOf(argv[0]) % intOf(argv[1]);
+      if (remainder < 0) {
+        remainder = remainder + intOf(argv[1]);
       }
-      return(result);
+      return(makeInt(remainder));
     } else {
       printf("modulo function not given integers\n");
       evaluationError();
@@ -1078,315 +1085,116 @@ Value *primitiveModulo(Value *args)
     printf("too many/few args for modulo \n");
     evaluationError();
   }
-  return(args);
+  return(NULL);
 }
 
 
-Value *primitiveGreater(Value *args)
+// The orders a comparison accepts between each argument and the next.
+#define ORDER_LESS    1
+#define ORDER_EQUAL   2
+#define ORDER_GREATER 4
+
+// How a compares to b, both numbers: ORDER_LESS, ORDER_EQUAL or
+// ORDER_GREATER, or 0 if they're unordered (a NaN).
+int compareNumbers(char *op, Value *a, Value *b)
 {
-  Value* result = talloc(sizeof(Value));
-  result->type = BOOL_TYPE;
-  int int1;
-  int int2;
-  double d1;
-  double d2;
-  if (length(args) == 2) {
-    if (car(args)->type == INT_TYPE && car(cdr(args))->type == INT_TYPE) {
-      int1 = car(args)->i;
-      int2 = car(cdr(args))->i;
-      if (int1 > int2) {
-        result->i = 1;
-      } else {
-        result->i = 0;
-      }
-      return (result);
-    } else if (car(args)->type == INT_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        int1 = car(args)->i;
-        d2 = car(cdr(args))->d;
-        if (int1 > d2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == INT_TYPE) {
-        d1 = car(args)->d;
-        int2 = car(cdr(args))->i;
-        if (d1 > int2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        d1 = car(args)->d;
-        d2 = car(cdr(args))->d;
-        if (d1 > d2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return(result);
-    } else {
-      printf("> function not given numbers\n");
-      evaluationError();
-    }
+  if (typeOf(a) == INT_TYPE && typeOf(b) == INT_TYPE) {
+    long int1 = intOf(a);
+    long int2 = intOf(b);
+    return(int1 < int2 ? ORDER_LESS : int1 > int2 ? ORDER_GREATER : ORDER_EQUAL);
+  }
+  double d1 = 0;
+  double d2 = 0;
+  if (typeOf(a) == INT_TYPE && typeOf(b) == DOUBLE_TYPE) {
+    d1 = intOf(a);
+    d2 = b->d;
+  } else if (typeOf(a) == DOUBLE_TYPE && typeOf(b) == INT_TYPE) {
+    d1 = a->d;
+    d2 = intOf(b);
+  } else if (typeOf(a) == DOUBLE_TYPE && typeOf(b) == DOUBLE_TYPE) {
+    d1 = a->d;
+    d2 = b->d;
   } else {
-    printf("too many/few args for > \n");
+    printf("%s function not given numbers\n", op);
     evaluationError();
   }
-  return(args);
+  if (d1 < d2) {
+    return(ORDER_LESS);
+  } else if (d1 > d2) {
+    return(ORDER_GREATER);
+  } else if (d1 == d2) {
+    return(ORDER_EQUAL);
+  }
+  return(0);
 }
 
-
-Value *primitiveLess(Value *args)
+// Whether each of the two or more arguments is in one of the orders in
+// accepted to the next, as <, >, <=, >= and = check. Every argument must be
+// a number, even after the answer is known.
+Value *compareChain(char *op, int accepted, int argc, Value **argv)
 {
-  if (length(args) == 2) {
-    Value* result = talloc(sizeof(Value));
-    result->type = BOOL_TYPE;
-    int int1;
-    int int2;
-    double d1;
-    double d2;
-    if (car(args)->type == INT_TYPE && car(cdr(args))->type == INT_TYPE) {
-      int1 = car(args)->i;
-      int2 = car(cdr(args))->i;
-      if (int1 < int2) {
-        result->i = 1;
-      } else {
-        result->i = 0;
-      }
-      return (result);
-    } else if (car(args)->type == INT_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        int1 = car(args)->i;
-        d2 = car(cdr(args))->d;
-        if (int1 < d2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == INT_TYPE) {
-        d1 = car(args)->d;
-        int2 = car(cdr(args))->i;
-        if (d1 < int2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        d1 = car(args)->d;
-        d2 = car(cdr(args))->d;
-        if (d1 < d2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return(result);
-    } else {
-      printf("< function not given numbers\n");
-      evaluationError();
-    }
-  } else {
-    printf("too many/few args for < \n");
+  if (argc < 2) {
+    printf("too many/few args for %s \n", op);
     evaluationError();
   }
-  return(args);
+  Value* result = TRUE_VALUE;
+  for (int i = 0; i + 1 < argc; i++) {
+    if ((compareNumbers(op, argv[i], argv[i + 1]) & accepted) == 0) {
+      result = FALSE_VALUE;
+    }
+  }
+  return(result);
 }
 
 
-Value *primitiveLessE (Value *args)
+Value *primitiveGreater(int argc, Value **argv)
 {
-  if (length(args) == 2) {
-    Value* result = talloc(sizeof(Value));
-    result->type = BOOL_TYPE;
-    int int1;
-    int int2;
-    double d1;
-    double d2;
-    if (car(args)->type == INT_TYPE && car(cdr(args))->type == INT_TYPE) {
-      int1 = car(args)->i;
-      int2 = car(cdr(args))->i;
-      if (int1 <= int2) {
-        result->i = 1;
-      } else {
-        result->i = 0;
-      }
-      return (result);
-    } else if (car(args)->type == INT_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        int1 = car(args)->i;
-        d2 = car(cdr(args))->d;
-        if (int1 <= d2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == INT_TYPE) {
-        d1 = car(args)->d;
-        int2 = car(cdr(args))->i;
-        if (d1 <= int2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        d1 = car(args)->d;
-        d2 = car(cdr(args))->d;
-        if (d1 <= d2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return(result);
-    } else {
-      printf("<= function not given numbers\n");
-      evaluationError();
-    }
-  } else {
-    printf("too many/few args for <= \n");
-    evaluationError();
-  }
-  return(args);
+  return(compareChain(">", ORDER_GREATER, argc, argv));
 }
 
 
-Value *primitiveGreaterE (Value *args)
+Value *primitiveLess(int argc, Value **argv)
 {
-  if (length(args) == 2) {
-    Value* result = talloc(sizeof(Value));
-    result->type = BOOL_TYPE;
-    int int1;
-    int int2;
-    double d1;
-    double d2;
-    if (car(args)->type == INT_TYPE && car(cdr(args))->type == INT_TYPE) {
-      int1 = car(args)->i;
-      int2 = car(cdr(args))->i;
-      if (int1 >= int2) {
-        result->i = 1;
-      } else {
-        result->i = 0;
-      }
-      return (result);
-    } else if (car(args)->type == INT_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        int1 = car(args)->i;
-        d2 = car(cdr(args))->d;
-        if (int1 >= d2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == INT_TYPE) {
-        d1 = car(args)->d;
-        int2 = car(cdr(args))->i;
-        if (d1 >= int2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        d1 = car(args)->d;
-        d2 = car(cdr(args))->d;
-        if (d1 >= d2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return(result);
-    } else {
-      printf(">= function not given numbers\n");
-      evaluationError();
-    }
-  } else {
-    printf("too many/few args for >= \n");
-    evaluationError();
-  }
-  return(args);
+  return(compareChain("<", ORDER_LESS, argc, argv));
 }
 
 
-Value *primitiveEqual(Value *args)
+Value *primitiveLessE (int argc, Value **argv)
 {
-  if (length(args) == 2) {
-    Value* result = talloc(sizeof(Value));
-    result->type = BOOL_TYPE;
-    int int1;
-    int int2;
-    double d1;
-    double d2;
-    if (car(args)->type == INT_TYPE && car(cdr(args))->type == INT_TYPE) {
-      int1 = car(args)->i;
-      int2 = car(cdr(args))->i;
-      if (int1 == int2) {
-        result->i = 1;
-      } else {
-        result->i = 0;
-      }
-      return (result);
-    } else if (car(args)->type == INT_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        int1 = car(args)->i;
-        d2 = car(cdr(args))->d;
-        if (int1 == d2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == INT_TYPE) {
-        d1 = car(args)->d;
-        int2 = car(cdr(args))->i;
-        if (d1 == int2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return (result);
-    } else if (car(args)->type == DOUBLE_TYPE && car(cdr(args))->type == DOUBLE_TYPE) {
-        d1 = car(args)->d;
-        d2 = car(cdr(args))->d;
-        if (d1 == d2) {
-          result->i = 1;
-        } else {
-          result->i = 0;
-        }
-        return(result);
-    } else {
-      printf("= function not given numbers\n");
-      evaluationError();
-    }
-  } else {
-    printf("too many/few args for = \n");
-    evaluationError();
-  }
-  return(args);
+  return(compareChain("<=", ORDER_LESS | ORDER_EQUAL, argc, argv));
+}
+
+
+Value *primitiveGreaterE (int argc, Value **argv)
+{
+  return(compareChain(">=", ORDER_GREATER | ORDER_EQUAL, argc, argv));
+}
+
+
+Value *primitiveEqual(int argc, Value **argv)
+{
+  return(compareChain("=", ORDER_EQUAL, argc, argv));
 }
 
 
-Value *primitiveEq(Value *args)
+Value *primitiveEq(int argc, Value **argv)
 {
-  if (length(args) == 2) {
-    Value* result = talloc(sizeof(Value));
-    void*  ptr1   = talloc(sizeof(void*));
-    void*  ptr2   = talloc(sizeof(void*));
-    result->type = BOOL_TYPE;
-    ptr1 = &car(args)->s;
-    ptr2 = &car(cdr(args))->s;
-    if (ptr1 == ptr2) {
-      result->i = 1;
+  if (argc == 2) {
+    Value* result = FALSE_VALUE;
+    Value* ptr1   = argv[0];
+    Value* ptr2   = argv[1];
+    // numbers are never eq?; compare them with =
+    if (ptr1 == ptr2 && typeOf(ptr1) != INT_TYPE && typeOf(ptr1) != DOUBLE_TYPE) {
+      result = TRUE_VALUE;
     } else {
-      result->i = 0;
+      result = FALSE_VALUE;
     }
     return(result);
   } else {
     printf("too many/few args for eq?\n");
     evaluationError();
   }
-  return(args);
+  return(NULL);
 }
 
 
@@ -1396,3 +1204,10 @@ void evaluationError()
   texit(EXIT_FAILURE);
   return;
 }
+
+void limitError(char *what, long limit, int status)
+{
+  fflush(stdout);
+  fprintf(stderr, "Error: %s limit of %ld exceeded\n", what, limit);
+  texit(status);
+}
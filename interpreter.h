@@ -1,18 +1,75 @@
 #ifndef _INTERPRETER
 #define _INTERPRETER
 
-// A frame is a linked list of bindings, and a pointer to another frame.  A
-// binding is a variable name (represented as a string), and a pointer to the
-// Value it is bound to. Specifically how you implement the list of bindings is
-// up to you.
+// A frame holds the local variables of a call or a let form, one slot each,
+// and a pointer to the frame it is nested in. The analyzer (analyze.h) turns
+// each local variable into how many parents up its frame is and which slot
+// it is in, so frames don't keep names. Globals aren't in frames, and the
+// frame of a top-level form is NULL.
+// captured is set once a closure holds on to the frame or one of its
+// descendants; until then the frame is freed as soon as its body returns.
 struct Frame {
-    Value *bindings;
     struct Frame *parent;
+    int count;            // slots
+    int captured;
+    Value *slots[];
 };
 
 typedef struct Frame Frame;
 
 void interpret(Value *tree);
-Value *eval(Value *tree, Frame *frame);
+
+// Reads the program on stdin one top-level form at a time, evaluating and
+// printing each before reading the next.
+void interpretInput();
+
+// Analyzes tree (analyze.h), a top-level form, and runs it.
+Value *eval(Value *tree);
+
+// What running a node does besides evaluating its kids, shared with the
+// bytecode VM (vm.c). lookUpGlobal returns the value in a global's binding
+// cell (global.h); setLocal rebinds the slot depth frames up from frame and
+// setGlobal a global's cell, as set! does; newFrame makes
+// a frame of count slots for site to count it against; evalLambda makes a
+// closure of a LAMBDA_NODE in frame. apply calls a primitive with the argc
+// evaluated arguments at argv, and bindArgs makes the frame for
+// calling a closure with them. releaseFrame recycles a frame whose body has
+// returned, unless a closure captured it.
+struct Node;
+Value *lookUpGlobal(Value *cell);
+void setLocal(Frame *frame, int depth, int slot, Value *val);
+void setGlobal(Value *cell, Value *val);
+Frame *newFrame(allocSite site, int count, Frame *parent);
+Value *evalLambda(struct Node *node, Frame *frame);
+Value *apply(Value *function, int argc, Value **argv);
+Frame *bindArgs(Value *function, int argc, Value **argv);
+void releaseFrame(Frame *frame);
+
+// Prints "Evaluation ERROR" and exits; callers print what went wrong first.
+void evaluationError();
+
+// Limits for running untrusted programs, set from the command line. Steps
+// are nodes run and depth is how many of them are nested, where a node in
+// tail position replaces the one it is in; when the C stack's own limit is
+// finite, running also stops before it runs out.
+extern long maxEvalSteps;
+extern long maxEvalDepth;
+extern long evalSteps;
+extern long evalDepth;
+
+// Exit statuses for a program stopped by a limit, distinct from the
+// EXIT_FAILURE every other error uses.
+#define EXIT_HEAP_LIMIT  3
+#define EXIT_STEP_LIMIT  4
+#define EXIT_DEPTH_LIMIT 5
+
+// Reports the limit that was hit on stderr and exits with status.
+void limitError(char *what, long limit, int status);
+
+// Stops with EXIT_DEPTH_LIMIT if here, the address of a local, is further
+// down the C stack than running may go. Whatever recurses on the C stack
+// (the analyzer, the bytecode compiler) checks at each level; exec and the VM
+// keep their continuations on the heap and don't need to.
+void checkStack(void *here);
 
 #endif
@@ -3,22 +3,34 @@
 #include <assert.h>
 #include <string.h>
 #include "talloc.h"
+#include "gc.h"
 
-// Create a new NULL_TYPE value node.
+// Create a new NULL_TYPE value node. The empty list is an immediate, so
+// nothing is allocated.
 Value *makeNull()
 {
-  Value *value = talloc(sizeof(Value));
-  value->type = NULL_TYPE;
+  countAlloc(SITE_MAKE_NULL, NULL_TYPE, 0);
+  return(NULL_VALUE);
+}
+
+// Create a new DOUBLE_TYPE value node.
+Value *makeDouble(double d)
+{
+  Value *value = gcAllocValue();
+  value->type = DOUBLE_TYPE;
+  value->d = d;
+  countAlloc(SITE_DOUBLE, DOUBLE_TYPE, sizeof(Value));
   return(value);
 }
 
 // Create a new CONS_TYPE value node.
 Value *cons(Value *car, Value *cdr)
 {
-  Value *cons = talloc(sizeof(Value));
+  Value *cons = gcAllocValue();
   cons->type = CONS_TYPE;
   (cons->c).car = car; //point to the same value pointed to by car
   (cons->c).cdr = cdr;
+  countAlloc(SITE_CONS, CONS_TYPE, sizeof(Value));
   return(cons);
 }
 
@@ -26,9 +38,9 @@ Value *cons(Value *car, Value *cdr)
 // readable format
 void display(Value *list)
 {
-  switch (list->type) {
+  switch (typeOf(list)) {
   case INT_TYPE:
-      printf("%i\n", list->i);
+      printf("%ld\n", intOf(list));
       break;
   case DOUBLE_TYPE:
       printf("%f\n", list->d);
@@ -37,8 +49,10 @@ void display(Value *list)
       printf("%s\n", list->s);
       break;
   case CONS_TYPE:
-      display((list->c).car); //recursively display on the sublist
-      display((list->c).cdr);
+      for (; typeOf(list) == CONS_TYPE; list = (list->c).cdr) {
+        display((list->c).car); //recursively display on the sublist
+      }
+      display(list); // what ends it, null for a proper list
       break;
   case NULL_TYPE:
       printf("null\n");
@@ -47,7 +61,7 @@ void display(Value *list)
       printf("%p\n", list->p);
       break;
   case BOOL_TYPE:
-      if(list->i == 0){
+      if(intOf(list) == 0){
         printf("False\n");
       } else {
         printf("True\n");
@@ -71,10 +85,11 @@ Value *reverse(Value *list)
   // And that the list was created using our cons function.
   Value *last = makeNull(); //root node
   Value *curr;
-  for (;list->type == CONS_TYPE; list = list->c.cdr) //increment through the list
+  for (;typeOf(list) == CONS_TYPE; list = list->c.cdr) //increment through the list
   {
-    curr = talloc(sizeof(Value)); //allocate mem for the cons-cell
+    curr = gcAllocValue(); //allocate mem for the cons-cell
     curr->type = CONS_TYPE;
+    countAlloc(SITE_REVERSE, CONS_TYPE, sizeof(Value));
     curr->c.car = list->c.car;
     curr->c.cdr = last; //append on the previous cons-cell
     last = curr; //change the address of the "root"
@@ -101,7 +116,7 @@ Value *cdr(Value *list)
 bool isNull(Value *value)
 {
    assert( value != NULL );
-   if(value->type == NULL_TYPE){
+   if(typeOf(value) == NULL_TYPE){
      return true;
    } else {
      return false;
@@ -112,10 +127,10 @@ bool isNull(Value *value)
 // operation.
 int length(Value *value)
 {
-  int i = 0; // start with 1
+  int i = 0;
   assert( value != NULL );
-  if(value->type == CONS_TYPE){
-    i = length(cdr(value)) + i + 1; //every cons-cell will add 1 to the count
+  for (; typeOf(value) == CONS_TYPE; value = cdr(value)) {
+    i++; //every cons-cell will add 1 to the count
   }
   return i;
 }
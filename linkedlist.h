@@ -7,6 +7,9 @@
 // Create a new NULL_TYPE value node.
 Value *makeNull();
 
+// Create a new DOUBLE_TYPE value node.
+Value *makeDouble(double d);
+
 // Create a new CONS_TYPE value node.
 Value *cons(Value *newCar, Value *newCdr);
 
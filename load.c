@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "talloc.h"
+#include "gc.h"
+#include "symbol.h"
+#include "load.h"
+
+// Parallel loading. A quick pre-scan that knows about parens, strings and
+// comments finds places between top-level forms that split the input into
+// chunks of about the same size. A pool of threads takes chunks in turn and
+// reads each one on its own, into per-thread nurseries; the per-chunk lists
+// of forms are then joined in order. Anything the pre-scan doesn't like
+// (unbalanced parens, an unterminated string) sends the input down the
+// ordinary path, so errors are reported exactly as before.
+//
+// If a chunk does have an error, its thread reports it and exits the
+// program; with errors in several chunks, which one gets reported is down to
+// timing.
+
+// Below this, threads cost more than they save.
+#define MIN_PARALLEL_INPUT (1 << 18)
+
+// Chunks per thread, so that a thread that finishes early can take another.
+#define CHUNKS_PER_JOB 4
+
+typedef struct LoadJob {
+  char **bounds;     // chunk i runs from bounds[i] to bounds[i + 1]
+  Value **trees;     // the forms of chunk i
+  int count;
+  int next;          // next chunk to hand out
+} LoadJob;
+
+typedef struct Loader {
+  pthread_t thread;
+  LoadJob *job;
+  GcNursery nursery; // what the thread allocated, for the main thread to adopt
+  AllocTables stats;
+} Loader;
+
+// Fills in up to count - 1 places to split the input, each just after a
+// newline the tokenizer would read between top-level forms, and returns the
+// number of chunks. Returns 0 if the parens don't balance or a string isn't
+// closed.
+int findChunks(char *start, char *end, char **bounds, int count)
+{
+  size_t step = (end - start) / count;
+  char *next = start + step;
+  int chunks = 1;
+  int depth = 0;
+  char *p = start;
+
+  bounds[0] = start;
+  while (p < end) {
+    char c = *p;
+    if (c == '\n') {
+      p++;
+      if (depth == 0 && p >= next && p < end && chunks < count) {
+        bounds[chunks++] = p;
+        next = p + step;
+      }
+    } else if (c == '(') {
+      depth++;
+      p++;
+    } else if (c == ')') {
+      if (--depth < 0) {
+        return(0);
+      }
+      p++;
+    } else if (c == '"') {
+      p = scanFor(SCAN_QUOTE, p + 1, end);
+      if (p == end) {
+        return(0);
+      }
+      p++;
+    } else if (c == ';') {
+      p = scanFor(SCAN_NEWLINE, p, end); // the newline counts as between forms
+    } else if (c >= 33 && c <= 126) {
+      p = scanFor(SCAN_SYMBOL_END, p, end);
+    } else {
+      p++;
+    }
+  }
+  if (depth != 0) {
+    return(0);
+  }
+  bounds[chunks] = end;
+  return(chunks);
+}
+
+void *runLoader(void *arg)
+{
+  Loader *loader = arg;
+  LoadJob *job = loader->job;
+  int i;
+  while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+    openRange(job->bounds[i], job->bounds[i + 1]);
+    job->trees[i] = readAll(nextToken);
+  }
+  loader->nursery = gcTakeNursery();
+  loader->stats = allocTables;
+  return(NULL);
+}
+
+// Tokenizes and parses the chunks on jobs threads and joins the results.
+Value *loadChunks(LoadJob *job, int jobs)
+{
+  Loader *loaders = talloc(sizeof(Loader) * jobs);
+  int started = 0;
+
+  tallocShare(1);
+  gcShare(1);
+  internShare(1);
+  for (int i = 0; i < jobs; i++) {
+    loaders[i].job = job;
+    if (pthread_create(&loaders[i].thread, NULL, runLoader, &loaders[i]) == 0) {
+      started++;
+    } else {
+      break;
+    }
+  }
+  if (started == 0) {
+    runLoader(&loaders[0]); // no threads to be had; do it here
+  }
+  for (int i = 0; i < started; i++) {
+    pthread_join(loaders[i].thread, NULL);
+  }
+  internShare(0);
+  gcShare(0);
+  tallocShare(0);
+
+  AllocStats loaded = {0, 0};
+  for (int i = 0; i < started; i++) {
+    gcAdoptNursery(loaders[i].nursery);
+    addAllocTables(&loaders[i].stats);
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+      loaded.count += loaders[i].stats.phase[phase].count;
+      loaded.bytes += loaders[i].stats.phase[phase].bytes;
+    }
+  }
+  if (started == 0) {
+    gcAdoptNursery(loaders[0].nursery);
+  }
+  if (profileNode != NULL) {
+    profilePhase("parallel load", 0);
+    profileNode->stats = loaded;
+  }
+
+  // join the chunks' lists of forms, last to first
+  Value *tree = makeNull();
+  for (int i = job->count - 1; i >= 0; i--) {
+    Value *forms = job->trees[i];
+    if (typeOf(forms) == NULL_TYPE) {
+      continue;
+    }
+    Value *last = forms;
+    while (typeOf(cdr(last)) != NULL_TYPE) {
+      last = cdr(last);
+    }
+    last->c.cdr = tree;
+    tree = forms;
+  }
+  return(tree);
+}
+
+Value *load(int jobs)
+{
+  size_t size;
+  char *input = readInput(&size);
+
+  if (jobs > 1 && size >= MIN_PARALLEL_INPUT) {
+    LoadJob job;
+    int count = jobs * CHUNKS_PER_JOB;
+    job.bounds = talloc(sizeof(char *) * (count + 1));
+    job.count = findChunks(input, input + size, job.bounds, count);
+    if (job.count > 1) {
+      job.trees = talloc(sizeof(Value *) * job.count);
+      job.next = 0;
+      return(loadChunks(&job, jobs < job.count ? jobs : job.count));
+    }
+  }
+
+  profilePhase("load", 0);
+  openRange(input, input + size);
+  return(readAll(nextToken));
+}
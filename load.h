@@ -0,0 +1,12 @@
+#include "value.h"
+
+#ifndef _LOAD
+#define _LOAD
+
+// Reads the program on stdin and returns its parse tree, the list of
+// top-level forms that interpret() takes. With jobs above 1, a large input
+// is split between top-level forms and the pieces are tokenized and parsed
+// on that many threads; the tree is the same either way.
+Value *load(int jobs);
+
+#endif
@@ -1,18 +1,106 @@
 #include <stdio.h>
-#include "tokenizer.h"
+#include <stdlib.h>
+#include <string.h>
+#include "load.h"
 #include "value.h"
 #include "linkedlist.h"
-#include "parser.h"
 #include "talloc.h"
+#include "gc.h"
 #include "interpreter.h"
+#include "vm.h"
 
-int main() {
+// Parses a positive count with an optional k, m or g suffix (powers of 1024);
+// returns 0 if it isn't one.
+long parseLimit(char *arg)
+{
+    char *end;
+    long count = strtol(arg, &end, 10);
+    if (*end == 'k' || *end == 'K') {
+        count <<= 10;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        count <<= 20;
+        end++;
+    } else if (*end == 'g' || *end == 'G') {
+        count <<= 30;
+        end++;
+    }
+    if (end == arg || *end != '\0' || count <= 0) {
+        return 0;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
 
-    Value *list = tokenize(stdin);
-    Value *tree = parse(list);
+    int gcStats = 0;    // --gc-stats: report collections on stderr at exit
+    int allocStats = 0; // --stats: also report allocations by site, type and phase
+    FILE *profile = NULL; // --heap-profile FILE: allocations per Scheme function
+    int jobs = 1;       // --jobs N: tokenize and parse a large program on N threads
+    int badArgs = 0;
+    for (int i = 1; i < argc && !badArgs; i++) {
+        long limit = 0;
+        if (i + 1 < argc) {
+            limit = parseLimit(argv[i + 1]);
+        }
+        if (!strcmp(argv[i], "--gc-stats")) {
+            gcStats = 1;
+        } else if (!strcmp(argv[i], "--stats")) {
+            allocStats = 1;
+            gcStats = 1;
+        } else if (!strcmp(argv[i], "--heap-profile") && i + 1 < argc) {
+            profile = fopen(argv[++i], "w");
+            if (profile == NULL) {
+                perror(argv[i]);
+                return 1;
+            }
+            startProfile();
+        } else if (!strcmp(argv[i], "--vm")) {
+            useVM = 1;
+        } else if (!strcmp(argv[i], "--jobs") && limit > 0) {
+            jobs = limit < 256 ? limit : 256;
+            i++;
+        } else if (!strcmp(argv[i], "--max-heap") && limit > 0) {
+            gcHeapLimit = limit;
+            i++;
+        } else if (!strcmp(argv[i], "--max-steps") && limit > 0) {
+            maxEvalSteps = limit;
+            i++;
+        } else if (!strcmp(argv[i], "--max-depth") && limit > 0) {
+            maxEvalDepth = limit;
+            i++;
+        } else {
+            badArgs = 1;
+        }
+    }
+    if (badArgs) {
+        fprintf(stderr, "Usage: %s [--gc-stats] [--stats] [--heap-profile FILE] [--jobs N]\n"
+                        "       [--vm] [--max-heap BYTES] [--max-steps N] [--max-depth N] < program\n"
+                        "--vm runs the program as bytecode. Limits take a k, m or g suffix. A\n"
+                        "program stopped by one exits with status %d (heap), %d (steps) or %d\n"
+                        "(depth); under --vm, steps and depth count calls of closures.\n",
+                argv[0], EXIT_HEAP_LIMIT, EXIT_STEP_LIMIT, EXIT_DEPTH_LIMIT);
+        return 1;
+    }
 
-    interpret(tree);
+    if (jobs > 1) {
+        Value *tree = load(jobs);
+        statsPhase = PHASE_EVAL;
+        interpret(tree);
+    } else {
+        interpretInput();
+    }
 
+    if (allocStats) {
+        reportAllocStats(stderr);
+    }
+    if (gcStats) {
+        gcReport(stderr);
+    }
+    if (profile != NULL) {
+        writeProfile(profile);
+        fclose(profile);
+    }
     tfree();
     return 0;
 }
@@ -0,0 +1,340 @@
+#include <stdlib.h>
+#include <string.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "number.h"
+
+// Decimal to double conversion, correctly rounded, in three tiers:
+//
+// - Clinger's fast path: when the mantissa fits in a double's 53 bits and
+//   10^|exponent| is exact, one multiply or divide rounds correctly.
+// - Eisel and Lemire's algorithm: multiply the mantissa by a 128-bit
+//   truncation of 5^exponent, which almost always pins down the rounded
+//   result. It gives up when it can't be sure.
+// - strtod on the lexeme, which glibc rounds exactly. The interpreter never
+//   calls setlocale, so the decimal point is always '.'.
+
+// Literals have no exponent part, so the exponent is minus the digits after
+// the point, or the digits dropped from a long integer; the table covers
+// every literal short enough to turn up in practice.
+#define MIN_POWER -128
+#define MAX_POWER 64
+
+// For q >= 0, the top 128 bits of 5^q. For q < 0, the top 128 bits of
+// 2^b / 5^-q + 1, with b = z + 127 for q >= -27 and 2z + 128 below that,
+// where 2^z is the smallest power of two >= 5^-q. The first word is the high
+// 64 bits.
+static const uint64_t powersOfFive[MAX_POWER - MIN_POWER + 1][2] = {
+  {0xddd0467c64bce4a0, 0xac7cb3f6d05ddbde}, // 5^-128
+  {0x8aa22c0dbef60ee4, 0x6bcdf07a423aa96b}, // 5^-127
+  {0xad4ab7112eb3929d, 0x86c16c98d2c953c6}, // 5^-126
+  {0xd89d64d57a607744, 0xe871c7bf077ba8b7}, // 5^-125
+  {0x87625f056c7c4a8b, 0x11471cd764ad4972}, // 5^-124
+  {0xa93af6c6c79b5d2d, 0xd598e40d3dd89bcf}, // 5^-123
+  {0xd389b47879823479, 0x4aff1d108d4ec2c3}, // 5^-122
+  {0x843610cb4bf160cb, 0xcedf722a585139ba}, // 5^-121
+  {0xa54394fe1eedb8fe, 0xc2974eb4ee658828}, // 5^-120
+  {0xce947a3da6a9273e, 0x733d226229feea32}, // 5^-119
+  {0x811ccc668829b887, 0x0806357d5a3f525f}, // 5^-118
+  {0xa163ff802a3426a8, 0xca07c2dcb0cf26f7}, // 5^-117
+  {0xc9bcff6034c13052, 0xfc89b393dd02f0b5}, // 5^-116
+  {0xfc2c3f3841f17c67, 0xbbac2078d443ace2}, // 5^-115
+  {0x9d9ba7832936edc0, 0xd54b944b84aa4c0d}, // 5^-114
+  {0xc5029163f384a931, 0x0a9e795e65d4df11}, // 5^-113
+  {0xf64335bcf065d37d, 0x4d4617b5ff4a16d5}, // 5^-112
+  {0x99ea0196163fa42e, 0x504bced1bf8e4e45}, // 5^-111
+  {0xc06481fb9bcf8d39, 0xe45ec2862f71e1d6}, // 5^-110
+  {0xf07da27a82c37088, 0x5d767327bb4e5a4c}, // 5^-109
+  {0x964e858c91ba2655, 0x3a6a07f8d510f86f}, // 5^-108
+  {0xbbe226efb628afea, 0x890489f70a55368b}, // 5^-107
+  {0xeadab0aba3b2dbe5, 0x2b45ac74ccea842e}, // 5^-106
+  {0x92c8ae6b464fc96f, 0x3b0b8bc90012929d}, // 5^-105
+  {0xb77ada0617e3bbcb, 0x09ce6ebb40173744}, // 5^-104
+  {0xe55990879ddcaabd, 0xcc420a6a101d0515}, // 5^-103
+  {0x8f57fa54c2a9eab6, 0x9fa946824a12232d}, // 5^-102
+  {0xb32df8e9f3546564, 0x47939822dc96abf9}, // 5^-101
+  {0xdff9772470297ebd, 0x59787e2b93bc56f7}, // 5^-100
+  {0x8bfbea76c619ef36, 0x57eb4edb3c55b65a}, // 5^-99
+  {0xaefae51477a06b03, 0xede622920b6b23f1}, // 5^-98
+  {0xdab99e59958885c4, 0xe95fab368e45eced}, // 5^-97
+  {0x88b402f7fd75539b, 0x11dbcb0218ebb414}, // 5^-96
+  {0xaae103b5fcd2a881, 0xd652bdc29f26a119}, // 5^-95
+  {0xd59944a37c0752a2, 0x4be76d3346f0495f}, // 5^-94
+  {0x857fcae62d8493a5, 0x6f70a4400c562ddb}, // 5^-93
+  {0xa6dfbd9fb8e5b88e, 0xcb4ccd500f6bb952}, // 5^-92
+  {0xd097ad07a71f26b2, 0x7e2000a41346a7a7}, // 5^-91
+  {0x825ecc24c873782f, 0x8ed400668c0c28c8}, // 5^-90
+  {0xa2f67f2dfa90563b, 0x728900802f0f32fa}, // 5^-89
+  {0xcbb41ef979346bca, 0x4f2b40a03ad2ffb9}, // 5^-88
+  {0xfea126b7d78186bc, 0xe2f610c84987bfa8}, // 5^-87
+  {0x9f24b832e6b0f436, 0x0dd9ca7d2df4d7c9}, // 5^-86
+  {0xc6ede63fa05d3143, 0x91503d1c79720dbb}, // 5^-85
+  {0xf8a95fcf88747d94, 0x75a44c6397ce912a}, // 5^-84
+  {0x9b69dbe1b548ce7c, 0xc986afbe3ee11aba}, // 5^-83
+  {0xc24452da229b021b, 0xfbe85badce996168}, // 5^-82
+  {0xf2d56790ab41c2a2, 0xfae27299423fb9c3}, // 5^-81
+  {0x97c560ba6b0919a5, 0xdccd879fc967d41a}, // 5^-80
+  {0xbdb6b8e905cb600f, 0x5400e987bbc1c920}, // 5^-79
+  {0xed246723473e3813, 0x290123e9aab23b68}, // 5^-78
+  {0x9436c0760c86e30b, 0xf9a0b6720aaf6521}, // 5^-77
+  {0xb94470938fa89bce, 0xf808e40e8d5b3e69}, // 5^-76
+  {0xe7958cb87392c2c2, 0xb60b1d1230b20e04}, // 5^-75
+  {0x90bd77f3483bb9b9, 0xb1c6f22b5e6f48c2}, // 5^-74
+  {0xb4ecd5f01a4aa828, 0x1e38aeb6360b1af3}, // 5^-73
+  {0xe2280b6c20dd5232, 0x25c6da63c38de1b0}, // 5^-72
+  {0x8d590723948a535f, 0x579c487e5a38ad0e}, // 5^-71
+  {0xb0af48ec79ace837, 0x2d835a9df0c6d851}, // 5^-70
+  {0xdcdb1b2798182244, 0xf8e431456cf88e65}, // 5^-69
+  {0x8a08f0f8bf0f156b, 0x1b8e9ecb641b58ff}, // 5^-68
+  {0xac8b2d36eed2dac5, 0xe272467e3d222f3f}, // 5^-67
+  {0xd7adf884aa879177, 0x5b0ed81dcc6abb0f}, // 5^-66
+  {0x86ccbb52ea94baea, 0x98e947129fc2b4e9}, // 5^-65
+  {0xa87fea27a539e9a5, 0x3f2398d747b36224}, // 5^-64
+  {0xd29fe4b18e88640e, 0x8eec7f0d19a03aad}, // 5^-63
+  {0x83a3eeeef9153e89, 0x1953cf68300424ac}, // 5^-62
+  {0xa48ceaaab75a8e2b, 0x5fa8c3423c052dd7}, // 5^-61
+  {0xcdb02555653131b6, 0x3792f412cb06794d}, // 5^-60
+  {0x808e17555f3ebf11, 0xe2bbd88bbee40bd0}, // 5^-59
+  {0xa0b19d2ab70e6ed6, 0x5b6aceaeae9d0ec4}, // 5^-58
+  {0xc8de047564d20a8b, 0xf245825a5a445275}, // 5^-57
+  {0xfb158592be068d2e, 0xeed6e2f0f0d56712}, // 5^-56
+  {0x9ced737bb6c4183d, 0x55464dd69685606b}, // 5^-55
+  {0xc428d05aa4751e4c, 0xaa97e14c3c26b886}, // 5^-54
+  {0xf53304714d9265df, 0xd53dd99f4b3066a8}, // 5^-53
+  {0x993fe2c6d07b7fab, 0xe546a8038efe4029}, // 5^-52
+  {0xbf8fdb78849a5f96, 0xde98520472bdd033}, // 5^-51
+  {0xef73d256a5c0f77c, 0x963e66858f6d4440}, // 5^-50
+  {0x95a8637627989aad, 0xdde7001379a44aa8}, // 5^-49
+  {0xbb127c53b17ec159, 0x5560c018580d5d52}, // 5^-48
+  {0xe9d71b689dde71af, 0xaab8f01e6e10b4a6}, // 5^-47
+  {0x9226712162ab070d, 0xcab3961304ca70e8}, // 5^-46
+  {0xb6b00d69bb55c8d1, 0x3d607b97c5fd0d22}, // 5^-45
+  {0xe45c10c42a2b3b05, 0x8cb89a7db77c506a}, // 5^-44
+  {0x8eb98a7a9a5b04e3, 0x77f3608e92adb242}, // 5^-43
+  {0xb267ed1940f1c61c, 0x55f038b237591ed3}, // 5^-42
+  {0xdf01e85f912e37a3, 0x6b6c46dec52f6688}, // 5^-41
+  {0x8b61313bbabce2c6, 0x2323ac4b3b3da015}, // 5^-40
+  {0xae397d8aa96c1b77, 0xabec975e0a0d081a}, // 5^-39
+  {0xd9c7dced53c72255, 0x96e7bd358c904a21}, // 5^-38
+  {0x881cea14545c7575, 0x7e50d64177da2e54}, // 5^-37
+  {0xaa242499697392d2, 0xdde50bd1d5d0b9e9}, // 5^-36
+  {0xd4ad2dbfc3d07787, 0x955e4ec64b44e864}, // 5^-35
+  {0x84ec3c97da624ab4, 0xbd5af13bef0b113e}, // 5^-34
+  {0xa6274bbdd0fadd61, 0xecb1ad8aeacdd58e}, // 5^-33
+  {0xcfb11ead453994ba, 0x67de18eda5814af2}, // 5^-32
+  {0x81ceb32c4b43fcf4, 0x80eacf948770ced7}, // 5^-31
+  {0xa2425ff75e14fc31, 0xa1258379a94d028d}, // 5^-30
+  {0xcad2f7f5359a3b3e, 0x096ee45813a04330}, // 5^-29
+  {0xfd87b5f28300ca0d, 0x8bca9d6e188853fc}, // 5^-28
+  {0x9e74d1b791e07e48, 0x775ea264cf55347e}, // 5^-27
+  {0xc612062576589dda, 0x95364afe032a819e}, // 5^-26
+  {0xf79687aed3eec551, 0x3a83ddbd83f52205}, // 5^-25
+  {0x9abe14cd44753b52, 0xc4926a9672793543}, // 5^-24
+  {0xc16d9a0095928a27, 0x75b7053c0f178294}, // 5^-23
+  {0xf1c90080baf72cb1, 0x5324c68b12dd6339}, // 5^-22
+  {0x971da05074da7bee, 0xd3f6fc16ebca5e04}, // 5^-21
+  {0xbce5086492111aea, 0x88f4bb1ca6bcf585}, // 5^-20
+  {0xec1e4a7db69561a5, 0x2b31e9e3d06c32e6}, // 5^-19
+  {0x9392ee8e921d5d07, 0x3aff322e62439fd0}, // 5^-18
+  {0xb877aa3236a4b449, 0x09befeb9fad487c3}, // 5^-17
+  {0xe69594bec44de15b, 0x4c2ebe687989a9b4}, // 5^-16
+  {0x901d7cf73ab0acd9, 0x0f9d37014bf60a11}, // 5^-15
+  {0xb424dc35095cd80f, 0x538484c19ef38c95}, // 5^-14
+  {0xe12e13424bb40e13, 0x2865a5f206b06fba}, // 5^-13
+  {0x8cbccc096f5088cb, 0xf93f87b7442e45d4}, // 5^-12
+  {0xafebff0bcb24aafe, 0xf78f69a51539d749}, // 5^-11
+  {0xdbe6fecebdedd5be, 0xb573440e5a884d1c}, // 5^-10
+  {0x89705f4136b4a597, 0x31680a88f8953031}, // 5^-9
+  {0xabcc77118461cefc, 0xfdc20d2b36ba7c3e}, // 5^-8
+  {0xd6bf94d5e57a42bc, 0x3d32907604691b4d}, // 5^-7
+  {0x8637bd05af6c69b5, 0xa63f9a49c2c1b110}, // 5^-6
+  {0xa7c5ac471b478423, 0x0fcf80dc33721d54}, // 5^-5
+  {0xd1b71758e219652b, 0xd3c36113404ea4a9}, // 5^-4
+  {0x83126e978d4fdf3b, 0x645a1cac083126ea}, // 5^-3
+  {0xa3d70a3d70a3d70a, 0x3d70a3d70a3d70a4}, // 5^-2
+  {0xcccccccccccccccc, 0xcccccccccccccccd}, // 5^-1
+  {0x8000000000000000, 0x0000000000000000}, // 5^0
+  {0xa000000000000000, 0x0000000000000000}, // 5^1
+  {0xc800000000000000, 0x0000000000000000}, // 5^2
+  {0xfa00000000000000, 0x0000000000000000}, // 5^3
+  {0x9c40000000000000, 0x0000000000000000}, // 5^4
+  {0xc350000000000000, 0x0000000000000000}, // 5^5
+  {0xf424000000000000, 0x0000000000000000}, // 5^6
+  {0x9896800000000000, 0x0000000000000000}, // 5^7
+  {0xbebc200000000000, 0x0000000000000000}, // 5^8
+  {0xee6b280000000000, 0x0000000000000000}, // 5^9
+  {0x9502f90000000000, 0x0000000000000000}, // 5^10
+  {0xba43b74000000000, 0x0000000000000000}, // 5^11
+  {0xe8d4a51000000000, 0x0000000000000000}, // 5^12
+  {0x9184e72a00000000, 0x0000000000000000}, // 5^13
+  {0xb5e620f480000000, 0x0000000000000000}, // 5^14
+  {0xe35fa931a0000000, 0x0000000000000000}, // 5^15
+  {0x8e1bc9bf04000000, 0x0000000000000000}, // 5^16
+  {0xb1a2bc2ec5000000, 0x0000000000000000}, // 5^17
+  {0xde0b6b3a76400000, 0x0000000000000000}, // 5^18
+  {0x8ac7230489e80000, 0x0000000000000000}, // 5^19
+  {0xad78ebc5ac620000, 0x0000000000000000}, // 5^20
+  {0xd8d726b7177a8000, 0x0000000000000000}, // 5^21
+  {0x878678326eac9000, 0x0000000000000000}, // 5^22
+  {0xa968163f0a57b400, 0x0000000000000000}, // 5^23
+  {0xd3c21bcecceda100, 0x0000000000000000}, // 5^24
+  {0x84595161401484a0, 0x0000000000000000}, // 5^25
+  {0xa56fa5b99019a5c8, 0x0000000000000000}, // 5^26
+  {0xcecb8f27f4200f3a, 0x0000000000000000}, // 5^27
+  {0x813f3978f8940984, 0x4000000000000000}, // 5^28
+  {0xa18f07d736b90be5, 0x5000000000000000}, // 5^29
+  {0xc9f2c9cd04674ede, 0xa400000000000000}, // 5^30
+  {0xfc6f7c4045812296, 0x4d00000000000000}, // 5^31
+  {0x9dc5ada82b70b59d, 0xf020000000000000}, // 5^32
+  {0xc5371912364ce305, 0x6c28000000000000}, // 5^33
+  {0xf684df56c3e01bc6, 0xc732000000000000}, // 5^34
+  {0x9a130b963a6c115c, 0x3c7f400000000000}, // 5^35
+  {0xc097ce7bc90715b3, 0x4b9f100000000000}, // 5^36
+  {0xf0bdc21abb48db20, 0x1e86d40000000000}, // 5^37
+  {0x96769950b50d88f4, 0x1314448000000000}, // 5^38
+  {0xbc143fa4e250eb31, 0x17d955a000000000}, // 5^39
+  {0xeb194f8e1ae525fd, 0x5dcfab0800000000}, // 5^40
+  {0x92efd1b8d0cf37be, 0x5aa1cae500000000}, // 5^41
+  {0xb7abc627050305ad, 0xf14a3d9e40000000}, // 5^42
+  {0xe596b7b0c643c719, 0x6d9ccd05d0000000}, // 5^43
+  {0x8f7e32ce7bea5c6f, 0xe4820023a2000000}, // 5^44
+  {0xb35dbf821ae4f38b, 0xdda2802c8a800000}, // 5^45
+  {0xe0352f62a19e306e, 0xd50b2037ad200000}, // 5^46
+  {0x8c213d9da502de45, 0x4526f422cc340000}, // 5^47
+  {0xaf298d050e4395d6, 0x9670b12b7f410000}, // 5^48
+  {0xdaf3f04651d47b4c, 0x3c0cdd765f114000}, // 5^49
+  {0x88d8762bf324cd0f, 0xa5880a69fb6ac800}, // 5^50
+  {0xab0e93b6efee0053, 0x8eea0d047a457a00}, // 5^51
+  {0xd5d238a4abe98068, 0x72a4904598d6d880}, // 5^52
+  {0x85a36366eb71f041, 0x47a6da2b7f864750}, // 5^53
+  {0xa70c3c40a64e6c51, 0x999090b65f67d924}, // 5^54
+  {0xd0cf4b50cfe20765, 0xfff4b4e3f741cf6d}, // 5^55
+  {0x82818f1281ed449f, 0xbff8f10e7a8921a4}, // 5^56
+  {0xa321f2d7226895c7, 0xaff72d52192b6a0d}, // 5^57
+  {0xcbea6f8ceb02bb39, 0x9bf4f8a69f764490}, // 5^58
+  {0xfee50b7025c36a08, 0x02f236d04753d5b4}, // 5^59
+  {0x9f4f2726179a2245, 0x01d762422c946590}, // 5^60
+  {0xc722f0ef9d80aad6, 0x424d3ad2b7b97ef5}, // 5^61
+  {0xf8ebad2b84e0d58b, 0xd2e0898765a7deb2}, // 5^62
+  {0x9b934c3b330c8577, 0x63cc55f49f88eb2f}, // 5^63
+  {0xc2781f49ffcfa6d5, 0x3cbf6b71c76b25fb}, // 5^64
+};
+
+static const double exactPowersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Sets *result to mantissa * 10^exponent, if that can be done exactly in
+// doubles.
+int clinger(uint64_t mantissa, int exponent, double *result)
+{
+  if (mantissa > ((uint64_t)1 << 53) || exponent < -22 || exponent > 22) {
+    return(0);
+  }
+  if (exponent < 0) {
+    *result = (double)mantissa / exactPowersOfTen[-exponent];
+  } else {
+    *result = (double)mantissa * exactPowersOfTen[exponent];
+  }
+  return(1);
+}
+
+// Sets *result to w * 10^q rounded to nearest, even on ties; returns 0 when
+// the 128-bit product leaves the rounding in doubt.
+int eiselLemire(uint64_t w, int q, double *result)
+{
+  if (w == 0) {
+    *result = 0;
+    return(1);
+  }
+  if (q < MIN_POWER || q > MAX_POWER) {
+    return(0);
+  }
+  int zeros = __builtin_clzll(w);
+  w <<= zeros;
+
+  // A 55-bit mantissa, one bit to round with and one to spare, needs the
+  // top 64 bits of the product to be right; if its low 9 bits are all ones,
+  // a carry from below could still change them, so bring in the second word.
+  const uint64_t *power = powersOfFive[q - MIN_POWER];
+  unsigned __int128 product = (unsigned __int128)w * power[0];
+  uint64_t high = (uint64_t)(product >> 64);
+  uint64_t low = (uint64_t)product;
+  if ((high & 0x1ff) == 0x1ff) {
+    uint64_t carry = (uint64_t)(((unsigned __int128)w * power[1]) >> 64);
+    low += carry;
+    if (carry > low) {
+      high++;
+    }
+  }
+  if (low == UINT64_MAX && (q < -27 || q > 55)) {
+    return(0); // past where the table is exact, and still on the edge
+  }
+
+  int upper = (int)(high >> 63);
+  int shift = upper + 64 - 52 - 3;
+  uint64_t mantissa = high >> shift;
+  // floor(q * log2(10)) + 63, the binary exponent of 10^q scaled by 2^63
+  int power2 = (((152170 + 65536) * q) >> 16) + 63 + upper - zeros + 1023;
+  if (power2 <= 0) {
+    return(0); // subnormal
+  }
+
+  // An exact tie can only come from a small q; round it to even.
+  if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 &&
+      (mantissa << shift) == high) {
+    mantissa &= ~(uint64_t)1;
+  }
+  mantissa += mantissa & 1;
+  mantissa >>= 1;
+  if (mantissa >= (uint64_t)2 << 52) {
+    mantissa = (uint64_t)1 << 52;
+    power2++;
+  }
+  mantissa &= ~((uint64_t)1 << 52);
+  if (power2 >= 0x7ff) {
+    return(0);
+  }
+
+  uint64_t bits = mantissa | (uint64_t)power2 << 52;
+  memcpy(result, &bits, sizeof(double));
+  return(1);
+}
+
+double decimalToDouble(Decimal *number, char *lexeme)
+{
+  double result;
+  if (!number->dropped) {
+    if (!clinger(number->mantissa, number->exponent, &result) &&
+        !eiselLemire(number->mantissa, number->exponent, &result)) {
+      return(strtod(lexeme, NULL));
+    }
+  } else {
+    // The digits after the first 19 put the value between mantissa and
+    // mantissa + 1; if both round the same way, so does the literal.
+    double above;
+    if (!eiselLemire(number->mantissa, number->exponent, &result) ||
+        !eiselLemire(number->mantissa + 1, number->exponent, &above) ||
+        result != above) {
+      return(strtod(lexeme, NULL));
+    }
+  }
+  return(number->negative ? -result : result);
+}
+
+Value *numberValue(Decimal *number, char *lexeme, int isDouble)
+{
+  if (!isDouble && !number->dropped && number->exponent == 0) {
+    if (number->mantissa <= FIXNUM_MAX) {
+      long i = (long)number->mantissa;
+      return(makeInt(number->negative ? -i : i));
+    }
+    if (number->negative && number->mantissa == (uint64_t)FIXNUM_MAX + 1) {
+      return(makeInt(FIXNUM_MIN));
+    }
+  }
+  // Integers too wide for a fixnum become the nearest double rather than
+  // wrapping around.
+  return(makeDouble(decimalToDouble(number, lexeme)));
+}
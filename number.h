@@ -0,0 +1,53 @@
+#include <stdint.h>
+#include "value.h"
+
+#ifndef _NUMBER
+#define _NUMBER
+
+// The tokenizer's number lexer. leadingDigit and leadingDecimal hand each
+// digit and point of a numeric literal to numberDigit and numberPoint as they
+// check it, so the number is built in the same pass, and then numberValue
+// makes the Value. A literal is mantissa * 10^exponent, with the mantissa
+// holding the first DECIMAL_DIGITS significant digits.
+#define DECIMAL_DIGITS 19
+
+typedef struct Decimal {
+  uint64_t mantissa;
+  int digits;    // significant digits in mantissa
+  int exponent;
+  int point;     // points seen; digits after a second one are ignored, as atof did
+  int dropped;   // a nonzero digit didn't fit in mantissa
+  int negative;
+} Decimal;
+
+static inline void numberDigit(Decimal *number, char digit)
+{
+  if (number->point > 1) {
+    return;
+  }
+  if (number->digits == 0 && digit == '0') {
+    number->exponent -= number->point; // leading zero
+  } else if (number->digits < DECIMAL_DIGITS) {
+    number->mantissa = number->mantissa * 10 + (digit - '0');
+    number->digits++;
+    number->exponent -= number->point;
+  } else {
+    number->dropped |= digit != '0';
+    number->exponent += !number->point;
+  }
+}
+
+static inline void numberPoint(Decimal *number)
+{
+  if (number->point < 2) {
+    number->point++;
+  }
+}
+
+// The literal as a fixnum if it has no point and fits in one, otherwise as
+// the nearest double. lexeme is its text, for the rare doubles that need an
+// exact slow path.
+Value *numberValue(Decimal *number, char *lexeme, int isDouble);
+double decimalToDouble(Decimal *number, char *lexeme);
+
+#endif
@@ -2,73 +2,127 @@
 #include "linkedlist.h"
 #include "tokenizer.h"
 #include "talloc.h"
+#include "gc.h"
+#include "parser.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 
-Value* addToParseTree(Value* tree, int* depth, Value* token);
 void displayValue(Value *list);
 void syntaxError_1();
 void syntaxError_2();
 void printInput(Value *tree);
 void printTree(Value *tree);
 
-// Takes a list of tokens from a Racket program, and returns a pointer to a
-// parse tree representing that program.
-Value *parse(Value *tokens)
-{
-  Value *tree = makeNull();
-  int depth = 0;
+// The lists still open while a datum is being built, innermost last. Each
+// is built front to back: tail is its last cell, NULL while it is empty.
+typedef struct OpenList {
+  Value *head;
+  Value *tail;
+} OpenList;
 
-  Value *current = tokens;
-  assert(current != NULL && "Error (parse): null pointer");
-  while (current->type != NULL_TYPE) {
-    Value *token = car(current);
-    tree = addToParseTree(tree, &depth, token);
-    current = cdr(current);
-  }
-  if (depth != 0) {
-    syntaxError_2(); // too few close paren
+_Thread_local OpenList *openLists = NULL;
+_Thread_local int openCapacity = 0;
+
+// Where parse is in its list of tokens.
+_Thread_local Value *tokenList = NULL;
+
+static Value *nextListedToken()
+{
+  if (typeOf(tokenList) == NULL_TYPE) {
+    return(NULL);
   }
-  tree = reverse(tree);
-  return(tree);
+  Value *token = car(tokenList);
+  tokenList = cdr(tokenList);
+  return(token);
 }
 
-// addToParseTree function takes in a pre-existing tree, a token to add to it,
-// and a pointer to an integer depth. depth is updated to represent the number
-// of unclosed open parentheses in the parse tree.
-Value* addToParseTree(Value* tree, int* depth, Value* token)
+// Builds the next datum from the tokens next returns, or returns NULL if
+// they run out first. Lists are kept on an explicit stack rather than the C
+// stack, so nesting is only limited by memory.
+static Value *buildDatum(Value *(*next)())
 {
-  Value* append_cell = talloc(sizeof(Value));
-
-  if (token->type == OPEN_TYPE) { // push
-
-    *depth = *depth + 1; // increase depth
-    append_cell->type = OPEN_TYPE;
-
-  } else if (token->type == CLOSE_TYPE) { // pop
-
-    *depth = *depth - 1; // decrease depth
+  int depth = 0;
 
-    if (*depth < 0) {
-      syntaxError_1(); // check for too many close paren
+  while (true) {
+    statsPhase = PHASE_TOKENIZE;
+    Value *token = next();
+    statsPhase = PHASE_PARSE;
+    if (token == NULL) {
+      if (depth != 0) {
+        syntaxError_2(); // too few close paren
+      }
+      return(NULL);
     }
 
-    Value *new_list = makeNull(); // start a new list
+    Value *datum = token;
+    if (typeOf(token) == OPEN_TYPE) { // push
+      if (depth == openCapacity) {
+        int capacity = openCapacity == 0 ? 64 : openCapacity * 2;
+        OpenList *bigger = talloc(sizeof(OpenList) * capacity);
+        if (depth > 0) {
+          memcpy(bigger, openLists, sizeof(OpenList) * depth);
+        }
+        openLists = bigger;
+        openCapacity = capacity;
+      }
+      openLists[depth].head = makeNull();
+      openLists[depth].tail = NULL;
+      depth++;
+      continue;
+    } else if (typeOf(token) == CLOSE_TYPE) { // pop
+      if (depth == 0) {
+        syntaxError_1(); // check for too many close paren
+      }
+      depth--;
+      datum = openLists[depth].head;
+    }
 
-    while (car(tree)->type != OPEN_TYPE) { // pop until an open paren is reached
-      new_list = cons(car(tree), new_list); // append onto the new list as your go
-      tree = cdr(tree);
+    if (depth == 0) {
+      return(datum);
+    }
+    OpenList *list = &openLists[depth - 1];
+    Value *cell = cons(datum, makeNull());
+    if (list->tail == NULL) {
+      list->head = cell;
+    } else {
+      list->tail->c.cdr = cell; // no collection can happen while parsing
     }
+    list->tail = cell;
+  }
+}
 
-    tree = cdr(tree); // gets rid of the open paren
-    append_cell = new_list; // packages who list as new item to pop onto the stack
+// Takes a list of tokens from a Racket program, and returns a pointer to a
+// parse tree representing that program.
+Value *parse(Value *tokens)
+{
+  assert(tokens != NULL && "Error (parse): null pointer");
+  tokenList = tokens;
+  return(readAll(nextListedToken));
+}
 
-  } else { // push
-    append_cell = token;
-  }
+Value *readDatum()
+{
+  return(buildDatum(nextToken));
+}
 
-  tree = cons(append_cell, tree); // pop onto the parse
+// Reads every datum that next returns into a list of them, built front to
+// back.
+Value *readAll(Value *(*next)())
+{
+  Value *tree = makeNull();
+  Value *last = NULL;
+  Value *datum;
+  while ((datum = buildDatum(next)) != NULL) {
+    Value *cell = cons(datum, makeNull());
+    if (last == NULL) {
+      tree = cell;
+    } else {
+      last->c.cdr = cell;
+    }
+    last = cell;
+  }
   return(tree);
 }
 
@@ -91,14 +145,14 @@ void syntaxError_2()
 // Racket code; use parentheses to indicate subtrees.
 void printInput(Value *tree)
 {
-  if (tree->type == VOID_TYPE){
+  if (typeOf(tree) == VOID_TYPE){
     return;
   }
-  if (tree->type != CONS_TYPE) {
+  if (typeOf(tree) != CONS_TYPE) {
     displayValue(tree);
   } else {
-    while (tree->type != NULL_TYPE) {
-      if(car(tree)->type != CONS_TYPE) {
+    while (typeOf(tree) != NULL_TYPE) {
+      if(typeOf(car(tree)) != CONS_TYPE) {
         displayValue(car(tree)); // display the value of the cell
       } else {
         printf("(");
@@ -111,38 +165,60 @@ void printInput(Value *tree)
   return;
 }
 
+// The rest of each list printTree is in the middle of, innermost last.
+Value **printRests = NULL;
+int printCapacity = 0;
+
+// Prints a result. Nested lists are kept on an explicit stack rather than
+// the C stack, as buildDatum does; cons nests each pair in the car, so a
+// long list is deep.
 void printTree(Value *tree)
 {
-  if (tree->type == VOID_TYPE){
+  if (typeOf(tree) == VOID_TYPE){
     return;
   }
-  if (tree->type != CONS_TYPE) {
+  if (typeOf(tree) != CONS_TYPE) {
     displayValue(tree);
-  } else {
-    while (tree->type != NULL_TYPE) {
-      if (car(tree)->type != CONS_TYPE) {
-        displayValue(car(tree)); // display the value of the cell
+    return;
+  }
+  int depth = 0;
+  while (true) {
+    if (typeOf(tree) == NULL_TYPE) { // the end of the list being printed
+      if (depth == 0) {
+        return;
+      }
+      printf(")");
+      tree = printRests[--depth];
+    } else if (typeOf(car(tree)) != CONS_TYPE) {
+      displayValue(car(tree)); // display the value of the cell
 
-        if (cdr(tree)->type == CONS_TYPE && cdr(cdr(tree))->type == NULL_TYPE) {
-          printf(". ");
-        }
-      } else {
-        printf("(");
-        printTree(car(tree)); // recursively print from perspective of the nested list
-        printf(")");
+      if (typeOf(cdr(tree)) == CONS_TYPE && typeOf(cdr(cdr(tree))) == NULL_TYPE) {
+        printf(". ");
       }
       tree = cdr(tree);
+    } else {
+      if (depth == printCapacity) {
+        int capacity = printCapacity == 0 ? 64 : printCapacity * 2;
+        Value **bigger = talloc(sizeof(Value *) * capacity);
+        if (depth > 0) {
+          memcpy(bigger, printRests, sizeof(Value *) * depth);
+        }
+        printRests = bigger;
+        printCapacity = capacity;
+      }
+      printf("(");
+      printRests[depth++] = cdr(tree); // print the nested list, then come back
+      tree = car(tree);
     }
   }
-  return;
 }
 
 // prints the value in the list. Should only print ints, doubles, strs, and bools without flagging an error
 void displayValue(Value *list)
 {
-  switch (list->type) {
+  switch (typeOf(list)) {
   case INT_TYPE:
-      printf("%i ", list->i);
+      printf("%ld ", intOf(list));
       break;
   case DOUBLE_TYPE:
       printf("%f ", list->d);
@@ -151,7 +227,7 @@ void displayValue(Value *list)
       printf("%s ", list->s);
       break;
   case BOOL_TYPE:
-      if(list->i == 0){
+      if(intOf(list) == 0){
         printf("#f ");
       } else {
         printf("#t ");
@@ -7,6 +7,15 @@
 // parse tree representing that program.
 Value *parse(Value *tokens);
 
+// Reads the next top-level datum of the input opened by openInput (see
+// tokenizer.h) and returns its parse tree, or NULL at the end of the input.
+// Only as much input is read as the datum needs.
+Value *readDatum();
+
+// Reads all the data next returns (nextToken, say) and returns the list of
+// their parse trees, as parse does for a list of tokens.
+Value *readAll(Value *(*next)());
+
 
 // Prints the tree to the screen in a readable fashion. It should look just like
 // Racket code; use parentheses to indicate subtrees.
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "tokenizer.h"
+#include "talloc.h"
+
+// Measures the tokenizer's scanning layer against its scalar fallback, in
+// MB/s. Usage: scanbench [file]. Without a file it scans a generated input
+// of quoted data lists and comments, like our generated data files. With
+// one, it also tokenizes the file both ways and checks the tokens match.
+
+#define GENERATED_SIZE (16 << 20)
+#define REPEATS 5
+
+// Builds the generated input, with a spare byte after it like the tokenizer's.
+char *generate(size_t *size)
+{
+  char *buffer = malloc(GENERATED_SIZE + 256);
+  size_t used = 0;
+  for (int i = 0; used < GENERATED_SIZE; i++) {
+    used += sprintf(buffer + used,
+                    "(quote (record-%d \"a string field, with spaces\" %d 6.25\n"
+                    "        (nested-symbol another-symbol) \"x\" ok))\n", i, i * 7);
+    if (i % 8 == 0) {
+      used += sprintf(buffer + used, ";; generated comment line, skipped up to its newline\n");
+    }
+  }
+  *size = used;
+  return(buffer);
+}
+
+char *readFile(char *name, size_t *size)
+{
+  FILE *file = fopen(name, "rb");
+  if (file == NULL) {
+    perror(name);
+    exit(1);
+  }
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *buffer = malloc(*size + 1);
+  if (fread(buffer, 1, *size, file) != *size) {
+    perror(name);
+    exit(1);
+  }
+  fclose(file);
+  return(buffer);
+}
+
+// Walks the input the way the tokenizer does, counting lexemes.
+long walk(char *p, char *end)
+{
+  long lexemes = 0;
+  while ((p = scanFor(SCAN_TOKEN, p, end)) < end) {
+    lexemes++;
+    if (*p == '(' || *p == ')') {
+      p++;
+    } else if (*p == '"') {
+      p = scanFor(SCAN_QUOTE, p + 1, end);
+      p += p < end;
+    } else if (*p == ';') {
+      p = scanFor(SCAN_NEWLINE, p, end);
+    } else {
+      p = scanFor(SCAN_SYMBOL_END, p, end);
+    }
+  }
+  return(lexemes);
+}
+
+double now()
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return(time.tv_sec + time.tv_nsec / 1e9);
+}
+
+// Best of REPEATS walks, in MB/s.
+double throughput(char *input, size_t size, long *lexemes)
+{
+  double best = 0;
+  for (int i = 0; i < REPEATS; i++) {
+    double start = now();
+    *lexemes = walk(input, input + size);
+    double rate = size / (now() - start) / (1 << 20);
+    if (rate > best) {
+      best = rate;
+    }
+  }
+  return(best);
+}
+
+// Tokenizes the file on stdin and returns the token list and the time taken.
+Value *tokenizeFile(char *name, double *seconds)
+{
+  if (freopen(name, "r", stdin) == NULL) {
+    perror(name);
+    exit(1);
+  }
+  double start = now();
+  Value *tokens = tokenize();
+  *seconds = now() - start;
+  return(tokens);
+}
+
+int sameTokens(Value *a, Value *b)
+{
+  for (; typeOf(a) == CONS_TYPE && typeOf(b) == CONS_TYPE; a = cdr(a), b = cdr(b)) {
+    Value *x = car(a);
+    Value *y = car(b);
+    if (typeOf(x) != typeOf(y)) {
+      return(0);
+    }
+    switch (typeOf(x)) {
+    case SYMBOL_TYPE:
+    case STR_TYPE:
+      if (strcmp(x->s, y->s)) {
+        return(0);
+      }
+      break;
+    case DOUBLE_TYPE:
+      if (x->d != y->d) {
+        return(0);
+      }
+      break;
+    default:
+      if (x != y && intOf(x) != intOf(y)) {
+        return(0);
+      }
+      break;
+    }
+  }
+  return(typeOf(a) == typeOf(b));
+}
+
+int main(int argc, char *argv[])
+{
+  size_t size;
+  char *input = argc > 1 ? readFile(argv[1], &size) : generate(&size);
+  long scalarLexemes, simdLexemes;
+
+  scalarScan = 1;
+  double scalar = throughput(input, size, &scalarLexemes);
+  scalarScan = 0;
+  double simd = throughput(input, size, &simdLexemes);
+
+  printf("scan: %.1f MB, %ld lexemes\n", size / (double)(1 << 20), simdLexemes);
+  printf("scan: scalar %8.1f MB/s\n", scalar);
+  printf("scan: simd   %8.1f MB/s (%.1fx)\n", simd, simd / scalar);
+  if (scalarLexemes != simdLexemes) {
+    printf("scan: MISMATCH, scalar found %ld lexemes\n", scalarLexemes);
+    return(1);
+  }
+
+  if (argc > 1) {
+    double scalarTime, simdTime;
+    scalarScan = 1;
+    Value *scalarTokens = tokenizeFile(argv[1], &scalarTime);
+    scalarScan = 0;
+    Value *simdTokens = tokenizeFile(argv[1], &simdTime);
+    printf("tokenize: scalar %8.1f MB/s\n", size / scalarTime / (1 << 20));
+    printf("tokenize: simd   %8.1f MB/s\n", size / simdTime / (1 << 20));
+    if (!sameTokens(scalarTokens, simdTokens)) {
+      printf("tokenize: MISMATCH between scalar and simd tokens\n");
+      return(1);
+    }
+  }
+  free(input);
+  tfree();
+  return(0);
+}
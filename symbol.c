@@ -0,0 +1,100 @@
+#include <string.h>
+#include <pthread.h>
+#include "value.h"
+#include "talloc.h"
+#include "gc.h"
+#include "symbol.h"
+
+// An open-addressing hash set of symbols, probed linearly, kept at most half
+// full. Each slot keeps its symbol's hash so that probing and growing rarely
+// have to look at names.
+typedef struct Slot {
+  unsigned int hash;
+  Value *symbol;      // NULL for an empty slot
+} Slot;
+
+Slot *symbols = NULL;
+size_t symbolCapacity = 0;
+size_t symbolCount = 0;
+
+pthread_mutex_t symbolLock = PTHREAD_MUTEX_INITIALIZER;
+int symbolsShared = 0;
+
+// FNV-1a. Symbols are short, so this is cheaper than anything fancier.
+static unsigned int hashName(char *name)
+{
+  unsigned int hash = 2166136261u;
+  for (unsigned char *p = (unsigned char *)name; *p; p++) {
+    hash = (hash ^ *p) * 16777619u;
+  }
+  return(hash);
+}
+
+static void growSymbols()
+{
+  size_t capacity = symbolCapacity == 0 ? 1024 : symbolCapacity * 2;
+  Slot *bigger = talloc(sizeof(Slot) * capacity);
+  memset(bigger, 0, sizeof(Slot) * capacity);
+  for (size_t i = 0; i < symbolCapacity; i++) {
+    if (symbols[i].symbol != NULL) {
+      size_t j = symbols[i].hash & (capacity - 1);
+      while (bigger[j].symbol != NULL) {
+        j = (j + 1) & (capacity - 1);
+      }
+      bigger[j] = symbols[i];
+    }
+  }
+  symbols = bigger;
+  symbolCapacity = capacity;
+}
+
+static Value *lookUp(char *name, int copy)
+{
+  unsigned int hash = hashName(name);
+  if (symbolsShared) {
+    pthread_mutex_lock(&symbolLock);
+  }
+  if (2 * (symbolCount + 1) > symbolCapacity) {
+    growSymbols();
+  }
+  size_t i = hash & (symbolCapacity - 1);
+  while (symbols[i].symbol != NULL &&
+         (symbols[i].hash != hash || strcmp(symbols[i].symbol->s, name))) {
+    i = (i + 1) & (symbolCapacity - 1);
+  }
+  Value *symbol = symbols[i].symbol;
+  if (symbol == NULL) {
+    symbol = gcAllocPermanent();
+    symbol->type = SYMBOL_TYPE;
+    if (copy) {
+      size_t length = strlen(name);
+      symbol->s = talloc(length + 1);
+      memcpy(symbol->s, name, length + 1);
+    } else {
+      symbol->s = name;
+    }
+    countAlloc(SITE_SYMBOL, SYMBOL_TYPE, sizeof(Value));
+    symbols[i].hash = hash;
+    symbols[i].symbol = symbol;
+    symbolCount++;
+  }
+  if (symbolsShared) {
+    pthread_mutex_unlock(&symbolLock);
+  }
+  return(symbol);
+}
+
+Value *intern(char *name)
+{
+  return(lookUp(name, 0));
+}
+
+Value *internCopy(char *name)
+{
+  return(lookUp(name, 1));
+}
+
+void internShare(int on)
+{
+  symbolsShared = on;
+}
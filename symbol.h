@@ -0,0 +1,20 @@
+#include "value.h"
+
+#ifndef _SYMBOL
+#define _SYMBOL
+
+// The symbol table. Every symbol Value comes from intern, which returns the
+// same Value for the same name, so two symbols are the same name exactly when
+// they are the same pointer. The name is kept, not copied: it has to outlive
+// the program, as lexemes in the input buffer and string literals do.
+// Interned symbols are never collected.
+Value *intern(char *name);
+
+// Like intern, but copies the name if it is new, for names in a buffer that
+// is going to be reused.
+Value *internCopy(char *name);
+
+// While other threads are tokenizing (a parallel load), intern takes a lock.
+void internShare(int on);
+
+#endif
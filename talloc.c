@@ -1,40 +1,116 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
 #include "value.h"
+#include "talloc.h"
 
-// Replacement for malloc that stores the pointers allocated. It should store
-// the pointers in some kind of list; a linked list would do fine, but insert
-// here whatever code you'll need to do so; don't call functions in the
-// pre-existing linkedlist.h. Otherwise you'll end up with circular
-// dependencies, since you're going to modify the linked list to use talloc.
-Value *list = NULL; //Initializes global active-list
+// Replacement for malloc that hands out memory from a chunked arena. Memory is
+// taken from large blocks ("chunks") by bumping a pointer, so an allocation is
+// an add and a compare instead of a call to malloc. Nothing is freed
+// individually; tfree releases the chunks themselves.
+
+// Size of a regular chunk. Requests larger than a quarter of this get a chunk
+// of their own so they don't waste the tail of the current one.
+#define CHUNK_SIZE  (1 << 20)
+#define BIG_REQUEST (CHUNK_SIZE / 4)
+
+// Every allocation is rounded up to this so that doubles and pointers stay
+// aligned.
+#define ALIGNMENT   16
+
+typedef struct Chunk {
+  struct Chunk *next; // previously filled chunk
+  char *bump;         // first free byte
+  char *end;          // one past the last usable byte
+} Chunk;
+
+// Keeps the payload of every chunk aligned.
+#define CHUNK_HEADER ((sizeof(Chunk) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))
+
+Chunk *chunks = NULL; // chunk currently being bumped, heads the chunk list
+
+pthread_mutex_t chunkLock = PTHREAD_MUTEX_INITIALIZER;
+int tallocShared = 0; // other threads are allocating too
+
+_Thread_local AllocTables allocTables;
+_Thread_local allocPhase statsPhase = PHASE_TOKENIZE;
+
+_Thread_local ProfileNode *profileNode = NULL;
+ProfileNode *profileRoot = NULL;
+
+// Mallocs a chunk with room for at least size bytes.
+static Chunk *newChunk(size_t size)
+{
+  Chunk *chunk = malloc(CHUNK_HEADER + size);
+  if (chunk == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  chunk->bump = (char *)chunk + CHUNK_HEADER;
+  chunk->end = chunk->bump + size;
+  chunk->next = NULL;
+  return(chunk);
+}
+
+// Slow path of talloc: the current chunk can't fit size bytes.
+static void *tallocChunk(size_t size)
+{
+  if (size > BIG_REQUEST) {
+    // gets its own chunk, linked in behind the current one so the current
+    // chunk keeps being bumped
+    Chunk *big = newChunk(size);
+    big->bump = big->end;
+    if (chunks == NULL) {
+      chunks = big;
+    } else {
+      big->next = chunks->next;
+      chunks->next = big;
+    }
+    return(big->end - size);
+  }
+  Chunk *chunk = newChunk(CHUNK_SIZE);
+  chunk->next = chunks;
+  chunks = chunk;
+  void *val = chunk->bump;
+  chunk->bump += size;
+  return(val);
+}
 
 void *talloc(size_t size)
 {
-  Value *val = malloc(size); // allocate space for use
-  Value *new_list = malloc(sizeof(Value)); // create a cons-cell
-  new_list->type = CONS_TYPE;
-  new_list->c.car = val; // point to the location allocated
-  new_list->c.cdr = list; // append the global list on
-  list = new_list; // reassign the pointer of the global list to look at our whole new list
-  return(val); // return the address of the usable point in memory
+  size = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+  countAlloc(SITE_TALLOC, BYTES_STAT, size);
+  if (tallocShared) {
+    pthread_mutex_lock(&chunkLock);
+  }
+  void *val;
+  if (chunks != NULL && (size_t)(chunks->end - chunks->bump) >= size) {
+    val = chunks->bump; // fast path: bump the pointer
+    chunks->bump += size;
+  } else {
+    val = tallocChunk(size);
+  }
+  if (tallocShared) {
+    pthread_mutex_unlock(&chunkLock);
+  }
+  return(val);
+}
+
+void tallocShare(int on)
+{
+  tallocShared = on;
 }
 
-// Free all pointers allocated by talloc, as well as whatever memory you
-// allocated in lists to hold those pointers.
+// Free all pointers allocated by talloc by releasing every chunk.
 void tfree()
 {
-  while(list->type == CONS_TYPE && (list->c.cdr) != 0){
-    // if the list point anywhere other than address 0
-    free(list->c.car); // free's the useable value box
-    Value *temp;
-    temp = list; // save the location of the active-list's head
-    list = list->c.cdr; // change the active-list to a sublist
-    free(temp); // free the old head
+  while (chunks != NULL) {
+    Chunk *next = chunks->next;
+    free(chunks);
+    chunks = next;
   }
-  free(list->c.car); //completes a final free
-  free(list);
-  list = 0; //re-initializes
 }
 
 // Replacement for the C function "exit", that consists of two lines: it calls
@@ -42,6 +118,155 @@ void tfree()
 // you can exit your program, and all memory is automatically cleaned up.
 void texit(int status)
 {
-  tfree();
+  if (!tallocShared) {
+    tfree();
+  }
   exit(status);
 }
+
+static void reportTable(FILE *out, const char *title, const char **names,
+                        AllocStats *stats, int count)
+{
+  fprintf(out, "alloc: by %-14s %12s %14s\n", title, "count", "bytes");
+  for (int i = 0; i < count; i++) {
+    if (stats[i].count > 0) {
+      fprintf(out, "alloc:   %-15s %12ld %14zu\n", names[i], stats[i].count, stats[i].bytes);
+    }
+  }
+}
+
+static void addStats(AllocStats *to, AllocStats *from, int count)
+{
+  for (int i = 0; i < count; i++) {
+    to[i].count += from[i].count;
+    to[i].bytes += from[i].bytes;
+  }
+}
+
+void addAllocTables(AllocTables *tables)
+{
+  addStats(allocTables.site, tables->site, SITE_COUNT);
+  addStats(allocTables.type, tables->type, TYPE_STATS);
+  addStats(allocTables.phase, tables->phase, PHASE_COUNT);
+}
+
+void reportAllocStats(FILE *out)
+{
+  static const char *sites[SITE_COUNT] = {"cons", "makeNull", "reverse", "makeDouble",
+    "token", "parser", "closure", "apply frame", "let frame", "global", "intern", "analyze", "compile", "talloc"};
+  static const char *types[TYPE_STATS] = {"int", "double", "string", "cons", "null",
+    "ptr", "open", "close", "bool", "symbol", "void", "closure", "primitive",
+    "frame", "node", "code", "raw bytes"};
+  static const char *phases[PHASE_COUNT] = {"tokenize", "parse", "eval", "primitive"};
+
+  reportTable(out, "site", sites, allocTables.site, SITE_COUNT);
+  reportTable(out, "type", types, allocTables.type, TYPE_STATS);
+  reportTable(out, "phase", phases, allocTables.phase, PHASE_COUNT);
+}
+
+static ProfileNode *newProfileNode(ProfileNode *parent, const char *name, int form)
+{
+  ProfileNode *node = talloc(sizeof(ProfileNode));
+  node->name = name;
+  node->form = form;
+  node->parent = parent;
+  node->children = NULL;
+  node->stats.count = 0;
+  node->stats.bytes = 0;
+  if (parent != NULL) {
+    node->sibling = parent->children;
+    parent->children = node;
+  } else {
+    node->sibling = NULL;
+  }
+  return(node);
+}
+
+void startProfile()
+{
+  profileRoot = newProfileNode(NULL, "", 0);
+  profileNode = profileRoot;
+}
+
+void profilePhase(const char *name, int form)
+{
+  if (profileNode == NULL) {
+    return;
+  }
+  // forms only come once each, so there is no point looking for an old node
+  profileNode = newProfileNode(profileRoot, name, form);
+}
+
+void profileEnter(const char *name)
+{
+  // a function already on the path from its phase or form is recursion,
+  // direct or not, which goes on in that function's node
+  for (ProfileNode *node = profileNode; node != profileRoot && node->parent != profileRoot;
+       node = node->parent) {
+    if (!strcmp(node->name, name)) {
+      profileNode = node;
+      return;
+    }
+  }
+  ProfileNode *child = profileNode->children;
+  while (child != NULL && strcmp(child->name, name)) {
+    child = child->sibling;
+  }
+  if (child == NULL) {
+    child = newProfileNode(profileNode, name, 0);
+  }
+  profileNode = child;
+}
+
+// Prints the path from the root down to node, gathering it bottom up first.
+static void writePath(FILE *out, ProfileNode *node)
+{
+  static ProfileNode **path = NULL;
+  static int capacity = 0;
+  int depth = 0;
+  for (; node != profileRoot; node = node->parent) {
+    if (depth == capacity) {
+      int bigger = capacity == 0 ? 64 : capacity * 2;
+      ProfileNode **grown = talloc(sizeof(ProfileNode *) * bigger);
+      if (depth > 0) {
+        memcpy(grown, path, sizeof(ProfileNode *) * depth);
+      }
+      path = grown;
+      capacity = bigger;
+    }
+    path[depth++] = node;
+  }
+  while (depth > 0) {
+    node = path[--depth];
+    if (node->form > 0) {
+      fprintf(out, "%s %d", node->name, node->form);
+    } else {
+      fputs(node->name, out);
+    }
+    if (depth > 0) {
+      fputc(';', out);
+    }
+  }
+}
+
+// Visits the tree in the same order as a recursive walk would, children
+// before siblings, following the parent links back up instead of keeping a
+// stack.
+void writeProfile(FILE *out)
+{
+  ProfileNode *node = profileRoot;
+  while (node != NULL) {
+    if (node != profileRoot && node->stats.bytes > 0) {
+      writePath(out, node);
+      fprintf(out, " %zu\n", node->stats.bytes);
+    }
+    if (node->children != NULL) {
+      node = node->children;
+      continue;
+    }
+    while (node != NULL && node != profileRoot && node->sibling == NULL) {
+      node = node->parent;
+    }
+    node = node == NULL || node == profileRoot ? NULL : node->sibling;
+  }
+}
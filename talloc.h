@@ -1,24 +1,118 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include "value.h"
 
 #ifndef _TALLOC
 #define _TALLOC
 
-// Replacement for malloc that stores the pointers allocated. It should store
-// the pointers in some kind of list; a linked list would do fine, but insert
-// here whatever code you'll need to do so; don't call functions in the
-// pre-existing linkedlist.h. Otherwise you'll end up with circular
-// dependencies, since you're going to modify the linked list to use talloc.
+// Replacement for malloc. Memory comes from a chunked arena: each call bumps a
+// pointer through a large block and only goes to malloc when a block fills up.
+// Don't call functions in linkedlist.h from here, since the linked list is
+// built on top of talloc.
 void *talloc(size_t size);
 
-// Free all pointers allocated by talloc, as well as whatever memory you
-// allocated in lists to hold those pointers.
+// Free all pointers allocated by talloc by releasing the arena's chunks.
 void tfree();
 
+// While other threads are running (a parallel load), talloc takes a lock,
+// and texit exits without freeing memory they may still be using.
+void tallocShare(int on);
+
 // Replacement for the C function "exit", that consists of two lines: it calls
 // tfree before calling exit. It's useful to have later on; if an error happens,
 // you can exit your program, and all memory is automatically cleaned up.
 void texit(int status);
 
+// Allocation statistics, printed by --stats. Each Value, Frame, Node or Code is counted
+// by the function that asked for it (its site), by the type it was made with
+// and by the phase the interpreter was in; talloc counts its own raw bytes,
+// which include the collector's blocks. Immediates (ints, booleans) are free
+// and never counted, except makeNull, to show how often it is asked for.
+typedef enum {SITE_CONS, SITE_MAKE_NULL, SITE_REVERSE, SITE_DOUBLE, SITE_TOKEN,
+              SITE_PARSER, SITE_CLOSURE, SITE_APPLY_FRAME, SITE_LET_FRAME,
+              SITE_GLOBAL, SITE_SYMBOL, SITE_ANALYZE, SITE_COMPILE, SITE_TALLOC,
+              SITE_COUNT} allocSite;
+
+// PHASE_PRIMITIVE is eval while inside a primitive, so its allocations are
+// the primitives' results.
+typedef enum {PHASE_TOKENIZE, PHASE_PARSE, PHASE_EVAL, PHASE_PRIMITIVE,
+              PHASE_COUNT} allocPhase;
+
+// Slots after the valueTypes in typeStats.
+#define FRAME_STAT  (PRIMITIVE_TYPE + 1)
+#define NODE_STAT   (PRIMITIVE_TYPE + 2)
+#define CODE_STAT   (PRIMITIVE_TYPE + 3)
+#define BYTES_STAT  (PRIMITIVE_TYPE + 4)
+#define TYPE_STATS  (PRIMITIVE_TYPE + 5)
+
+typedef struct AllocStats {
+  long count;
+  size_t bytes;
+} AllocStats;
+
+// Each thread counts into tables of its own; a thread that helped load the
+// program hands a copy of its tables back and the main thread adds them to
+// its own with addAllocTables.
+typedef struct AllocTables {
+  AllocStats site[SITE_COUNT];
+  AllocStats type[TYPE_STATS];
+  AllocStats phase[PHASE_COUNT];
+} AllocTables;
+
+extern _Thread_local AllocTables allocTables;
+extern _Thread_local allocPhase statsPhase;
+
+void addAllocTables(AllocTables *tables);
+
+// Heap profile, for --heap-profile. While it is on, every Value and Frame is
+// also charged to a node of a calling-context tree: the closure running at
+// the time (named by the symbol it was called through, or "lambda"), under
+// the closures that called it, under the phase or top-level form. A closure
+// that is already on the path to the current node, because it called
+// itself directly or through others, goes back to its node there, so deep
+// recursion doesn't make deep trees: a path names each function once.
+typedef struct ProfileNode {
+  const char *name;
+  int form;                     // top-level form number, 0 for other nodes
+  struct ProfileNode *parent;
+  struct ProfileNode *children;
+  struct ProfileNode *sibling;
+  AllocStats stats;             // allocated while this node was running
+} ProfileNode;
+
+extern _Thread_local ProfileNode *profileNode; // node being charged, NULL unless profiling
+
+void startProfile();
+
+// Makes a child of the root (a phase, or top-level form number form) the
+// current node.
+void profilePhase(const char *name, int form);
+
+// Makes the child of the current node called name the current node; callers
+// save profileNode beforehand and put it back when the call returns.
+void profileEnter(const char *name);
+
+// Writes one line per node that allocated, in the "folded stacks" format
+// flame graph tools read: the path from the root separated by ';', a space,
+// and the bytes allocated there.
+void writeProfile(FILE *out);
+
+static inline void countAlloc(allocSite site, int type, size_t bytes)
+{
+  if (profileNode != NULL && site != SITE_TALLOC) {
+    profileNode->stats.count++;
+    profileNode->stats.bytes += bytes;
+  }
+  allocTables.site[site].count++;
+  allocTables.site[site].bytes += bytes;
+  allocTables.type[type].count++;
+  allocTables.type[type].bytes += bytes;
+  allocTables.phase[statsPhase].count++;
+  allocTables.phase[statsPhase].bytes += bytes;
+}
+
+// Prints the counts by site, type and phase.
+void reportAllocStats(FILE *out);
+
 #endif
 
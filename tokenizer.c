@@ -2,8 +2,16 @@
 #include "linkedlist.h"
 #include "tokenizer.h"
 #include "talloc.h"
+#include "gc.h"
+#include "number.h"
+#include "symbol.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Read all of the input from stdin, and return a linked list consisting of the
 // tokens.
@@ -24,53 +32,378 @@
   the linked list being improperly constructed with ptrs or cons-cells in the wrong spots
 */
 
-// Max buffer size
-#define  MAX_LEN  100
+// A regular file on stdin is brought into memory whole before tokenizing:
+// mapped if it can be, read in big blocks otherwise. Symbols, strings and
+// numbers aren't copied out of it; each token points at its lexeme in the
+// buffer, which is terminated in place by writing '\0' over the character
+// that ended it (the tokenizer has already read that character, so nothing
+// is lost). There is always one spare byte after the input for the last
+// lexeme's terminator. The buffer lives until the program exits.
+//
+// The tokenizer's position is per thread, so that separate stretches of the
+// buffer can be tokenized at the same time (see load.c).
+_Thread_local char *inputEnd = NULL;
+_Thread_local char *cursor = NULL;
+
+// A character a string's terminator was written over, to be returned by the
+// next nextChar. Only whitespace and parens are ever held.
+#define NO_CHAR (-2)
+_Thread_local int held = NO_CHAR;
+
+#define READ_SIZE (1 << 16)
+
+// The scanning layer. The tokenizer's inner loops (skipping whitespace and
+// comments, running to the end of a symbol or string) are searches for the
+// first byte of some class, done here 16 bytes at a time with SSE2. Unoptimized
+// builds (the Makefile's plain -g) leave every vector in memory and run the
+// SSE2 loop at under half the speed of the byte loop, so it is only compiled
+// in when optimizing. The last few bytes before the end, and everything when
+// scalarScan is set, go through the one-byte-at-a-time loop, which gives the
+// same answers.
+#if defined(__SSE2__) && defined(__OPTIMIZE__)
+#include <emmintrin.h>
+#define SCAN_WIDTH 16
+typedef __m128i ScanBlock;
+#define scanLoad(p)     _mm_loadu_si128((const __m128i *)(p))
+#define scanSplat(c)    _mm_set1_epi8(c)
+#define scanEq(a, b)    _mm_cmpeq_epi8(a, b)
+#define scanGt(a, b)    _mm_cmpgt_epi8(a, b)
+#define scanAnd(a, b)   _mm_and_si128(a, b)
+#define scanOr(a, b)    _mm_or_si128(a, b)
+#define scanBits(v)     ((unsigned)_mm_movemask_epi8(v))
+#define SCAN_ALL        0xffffu
+#endif
+
+int scalarScan = 0;
+
+// Whether c ends a run of the given kind.
+static inline int scanStops(int kind, unsigned char c)
+{
+  int printable = c >= 33 && c <= 126; // what the tokenizer doesn't skip
+  switch (kind) {
+  case SCAN_TOKEN:
+    return(printable);
+  case SCAN_SYMBOL_END:
+    return(!printable || c == 40 || c == 41);
+  case SCAN_NEWLINE:
+    return(c == '\n');
+  default:
+    return(c == '"');
+  }
+}
+
+// Returns the first byte from p on that ends a run of kind, or end. Called
+// with a constant kind, so each use compiles to its own loop.
+static inline char *scan(char *p, char *end, int kind)
+{
+#ifdef SCAN_WIDTH
+  if (!scalarScan) {
+    ScanBlock space = scanSplat(32);
+    ScanBlock tilde = scanSplat(127);
+    ScanBlock open = scanSplat(40);
+    ScanBlock close = scanSplat(41);
+    ScanBlock newline = scanSplat('\n');
+    ScanBlock quote = scanSplat('"');
+    while (end - p >= SCAN_WIDTH) {
+      ScanBlock block = scanLoad(p);
+      unsigned bits;
+      // bytes above 126 are negative as signed chars, so fail the first test
+      ScanBlock printable = scanAnd(scanGt(block, space), scanGt(tilde, block));
+      switch (kind) {
+      case SCAN_TOKEN:
+        bits = scanBits(printable);
+        break;
+      case SCAN_SYMBOL_END:
+        bits = (~scanBits(printable) & SCAN_ALL) |
+               scanBits(scanOr(scanEq(block, open), scanEq(block, close)));
+        break;
+      case SCAN_NEWLINE:
+        bits = scanBits(scanEq(block, newline));
+        break;
+      default:
+        bits = scanBits(scanEq(block, quote));
+        break;
+      }
+      if (bits != 0) {
+        return(p + __builtin_ctz(bits));
+      }
+      p += SCAN_WIDTH;
+    }
+  }
+#endif
+  while (p < end && !scanStops(kind, (unsigned char)*p)) {
+    p++;
+  }
+  return(p);
+}
+
+char *scanFor(int kind, char *p, char *end)
+{
+  switch (kind) {
+  case SCAN_TOKEN:
+    return(scan(p, end, SCAN_TOKEN));
+  case SCAN_SYMBOL_END:
+    return(scan(p, end, SCAN_SYMBOL_END));
+  case SCAN_NEWLINE:
+    return(scan(p, end, SCAN_NEWLINE));
+  default:
+    return(scan(p, end, SCAN_QUOTE));
+  }
+}
 
 // Helper function prototypes
-Value* Open(Value* list);
-Value* Close(Value* list);
-Value* leadingQuote(Value* list);
-Value* leadingDecimal(Value* list, char sign);
-Value* leadingDigit(Value* list, char charRead, char sign);
-Value* leadingSymbol(Value* list, char charRead, char sign);
+Value* Open();
+Value* Close();
+Value* leadingQuote();
+Value* leadingDecimal(char sign);
+Value* leadingDigit(char charRead, char sign);
+Value* leadingSymbol(char charRead, char sign);
+
+// A pipe or terminal isn't read to the end first. It is read a block at a
+// time whenever the tokenizer runs out of input, so that each form can be
+// evaluated as soon as it has been read (see readDatum). To make room, the
+// lexeme being read, from mark, is moved to the front of the buffer and the
+// rest is reused. Nothing may point into a streamed buffer once its token
+// is made, so symbol names go through internCopy and strings are copied.
+char *streamBuffer = NULL;
+size_t streamCapacity = 0;
+int streaming = 0;
+_Thread_local char *mark = NULL; // start of the lexeme being read, if any
+
+// Parens carry nothing, so every open paren token is the same Value, and
+// every close paren token too. They are made before any tokenizing starts.
+Value *openParen = NULL;
+Value *closeParen = NULL;
+
+static void makeParens()
+{
+  if (openParen == NULL) {
+    openParen = gcAllocPermanent();
+    openParen->type = OPEN_TYPE;
+    openParen->s = "(";
+    closeParen = gcAllocPermanent();
+    closeParen->type = CLOSE_TYPE;
+    closeParen->s = ")";
+  }
+}
+
+// Maps stdin if it is a regular file being read from the start whose size
+// leaves room for the terminator in its last page; copies it into a talloc'd
+// buffer otherwise.
+char *readInput(size_t *inputSize)
+{
+  int fd = fileno(stdin);
+  long page = sysconf(_SC_PAGESIZE);
+  struct stat info;
+  int regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+  makeParens();
+
+  if (regular && info.st_size > 0 && info.st_size % page != 0 &&
+      lseek(fd, 0, SEEK_CUR) == 0) {
+    void *mapped = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mapped != MAP_FAILED) {
+      *inputSize = info.st_size;
+      return(mapped);
+    }
+  }
+
+  size_t capacity = regular && info.st_size > 0 ? (size_t)info.st_size + 1 : READ_SIZE;
+  char *buffer = malloc(capacity);
+  size_t size = 0;
+  ssize_t count;
+  do {
+    if (capacity - size < READ_SIZE / 2) {
+      capacity *= 2;
+      buffer = realloc(buffer, capacity);
+    }
+    if (buffer == NULL) {
+      fprintf(stderr, "Error: out of memory reading input\n");
+      texit(EXIT_FAILURE);
+    }
+    count = read(fd, buffer + size, capacity - size - 1);
+    if (count > 0) {
+      size += count;
+    }
+  } while (count > 0);
+
+  // moved into the arena so that tfree releases it
+  char *input = talloc(size + 1);
+  memcpy(input, buffer, size);
+  free(buffer);
+  *inputSize = size;
+  return(input);
+}
+
+void openInput()
+{
+  struct stat info;
+  makeParens();
+  if (fstat(fileno(stdin), &info) == 0 && S_ISREG(info.st_mode)) {
+    size_t size;
+    char *input = readInput(&size);
+    cursor = input;
+    inputEnd = input + size;
+  } else {
+    streaming = 1;
+    streamCapacity = READ_SIZE;
+    streamBuffer = malloc(streamCapacity);
+    cursor = streamBuffer;
+    inputEnd = streamBuffer;
+  }
+  held = NO_CHAR;
+}
+
+// Reads more of a streamed input after what is left of the buffer, keeping
+// the lexeme being read. Returns 0 at the end of the input.
+static int refill()
+{
+  if (!streaming) {
+    return(0);
+  }
+  char *keep = mark != NULL ? mark : cursor;
+  size_t kept = inputEnd - keep;
+  size_t offset = cursor - keep;
+  if (streamCapacity - kept < READ_SIZE / 2) {
+    // a lexeme as big as the buffer
+    streamCapacity *= 2;
+    char *bigger = malloc(streamCapacity);
+    if (bigger == NULL) {
+      fprintf(stderr, "Error: out of memory reading input\n");
+      texit(EXIT_FAILURE);
+    }
+    memcpy(bigger, keep, kept);
+    free(streamBuffer);
+    streamBuffer = bigger;
+  } else {
+    memmove(streamBuffer, keep, kept);
+  }
+  if (mark != NULL) {
+    mark = streamBuffer;
+  }
+  cursor = streamBuffer + offset;
+  inputEnd = streamBuffer + kept;
+
+  fflush(stdout); // what has been printed so far, before waiting for more
+  ssize_t count;
+  do {
+    count = read(fileno(stdin), inputEnd, streamCapacity - kept - 1); // a spare byte
+  } while (count < 0 && errno == EINTR);
+  if (count <= 0) {
+    return(0);
+  }
+  inputEnd += count;
+  return(1);
+}
+
+// Returns the next character of the input, or EOF.
+int nextChar()
+{
+  if (held != NO_CHAR) {
+    int c = held;
+    held = NO_CHAR;
+    return(c);
+  }
+  if (cursor >= inputEnd && !refill()) {
+    return(EOF);
+  }
+  return((unsigned char)*cursor++);
+}
+
+// Moves the cursor to the first byte that ends a run of kind, reading more
+// of a streamed input on the way; leaves it at the end if the input runs out.
+static inline void skip(int kind)
+{
+  cursor = scan(cursor, inputEnd, kind);
+  while (cursor == inputEnd && refill()) {
+    cursor = scan(cursor, inputEnd, kind);
+  }
+}
+
+// Terminates the lexeme ended by charRead, the character just read, by
+// overwriting charRead in the buffer.
+void endLexeme(char charRead)
+{
+  if (charRead == EOF) {
+    *cursor = '\0'; // the spare byte after the input
+  } else {
+    cursor[-1] = '\0';
+  }
+}
+
+// Ends a number or symbol at charRead, like endLexeme. A paren there is held
+// back to be the next token.
+static void endToken(char charRead)
+{
+  endLexeme(charRead);
+  if (charRead == '(' || charRead == ')') {
+    held = charRead;
+  }
+}
 
 Value *tokenize()
 {
-  char charRead;
+  size_t size;
+  char *input = readInput(&size);
+  return(tokenizeRange(input, input + size));
+}
+
+void openRange(char *start, char *end)
+{
+  cursor = start;
+  inputEnd = end;
+  held = NO_CHAR;
+}
+
+Value *tokenizeRange(char *start, char *end)
+{
   Value *list = makeNull();
-  charRead = fgetc(stdin);
+  Value *token;
+  openRange(start, end);
+  while ((token = nextToken()) != NULL) {
+    list = cons(token, list);
+  }
+  Value *revList = reverse(list);
+  return revList;
+}
+
+Value *nextToken()
+{
+  Value *token = NULL;
 
-  while (charRead != EOF) {
+  while (token == NULL) {
+    if (held == NO_CHAR) {
+      skip(SCAN_TOKEN); // whitespace would be ignored anyway
+    }
+    int fromBuffer = held == NO_CHAR;
+    char charRead = nextChar();
+    mark = fromBuffer ? cursor - 1 : NULL;
+
+    if (charRead == EOF) {
+
+      break;
 
-    if (charRead == '"') { // STR //STR definition should have priority over all types
+    } else if (charRead == '"') { // STR //STR definition should have priority over all types
 
-      list = leadingQuote(list);
+      token = leadingQuote();
 
     } else if (charRead == '(') { // OPEN
 
-      list = Open(list);
+      token = Open();
 
     } else if (charRead == ')') { // CLOSE
 
-      list = Close(list);
+      token = Close();
 
     } else if (charRead == '#') { // BOOLEAN
 
-      charRead = fgetc(stdin);
+      charRead = nextChar();
       if (charRead == 'f'){ // Flags the boolean with its relevant value
 
-        Value *temp = talloc(sizeof(Value));
-        temp->type = BOOL_TYPE;
-        temp->i = 0;
-        list = cons(temp,list);
+        token = makeBool(0);
 
       } else if (charRead == 't'){
 
-        Value *temp = talloc(sizeof(Value));
-        temp->type = BOOL_TYPE;
-        temp->i = 1;
-        list = cons(temp,list);
+        token = makeBool(1);
 
       } else {
         // Error
@@ -82,18 +415,18 @@ Value *tokenize()
     } else if (charRead == '+' || charRead == '-'){
 
       char sign = charRead;
-      charRead = fgetc(stdin); // checks next char
+      charRead = nextChar(); // checks next char
       if (charRead == '.') { // Checks what we should project the role of '+/-' to be
 
-        list = leadingDecimal(list, sign);
+        token = leadingDecimal(sign);
 
       } else if (48 <= (int)charRead && (int)charRead <= 57) {
 
-        list = leadingDigit(list, charRead, sign);
+        token = leadingDigit(charRead, sign);
 
       } else if ((int)charRead == 32) { // interpret as single symbol
 
-        list = leadingSymbol(list, charRead, sign);
+        token = leadingSymbol(charRead, sign);
 
       } else {
         // Error
@@ -103,20 +436,18 @@ Value *tokenize()
 
     } else if (charRead == '.') { // Leading decimal
 
-      list = leadingDecimal(list, '0');
+      token = leadingDecimal('0');
 
     } else if (48 <= (int)charRead && (int)charRead <= 57) { // Leading digit
 
-      list = leadingDigit(list, charRead, '0');
+      token = leadingDigit(charRead, '0');
 
     } else if (charRead == ';') { // COMMENT
 
-      charRead = fgetc(stdin);
+      mark = NULL; // nothing to keep
+      charRead = nextChar();
       if (charRead == ';'){ // signals we have a comment
-        while (charRead != EOF && charRead != '\n') {
-          // ignores chars until we reach a new line
-          charRead = fgetc(stdin);
-        }
+        skip(SCAN_NEWLINE); // ignores chars until we reach a new line
       } else {
         // error.
         fprintf(stderr, "Error: ; followed by char other than ';'.\n");
@@ -126,79 +457,45 @@ Value *tokenize()
 
     } else if ((int)charRead >= 33 && (int)charRead <= 126) {
 
-      list = leadingSymbol(list, charRead, '0'); // The '0' is taking the place of the sign
+      token = leadingSymbol(charRead, '0'); // The '0' is taking the place of the sign
 
     }
-    charRead = fgetc(stdin);
-  } // End of While Loop
-
-   Value *revList = reverse(list);
-   return revList;
+  }
+  mark = NULL;
+  return(token);
 }
 
-// Helper function creates an open-type value cell
-Value* Open(Value* list)
+// Helper function returns the open-type token
+Value* Open()
 {
-  Value *temp = talloc(sizeof(Value));
-  temp->type = OPEN_TYPE;
-  char *open = talloc(sizeof(char));
-  *open = '(';
-  temp->s = open;
-  list = cons(temp,list);
-  return(list);
+  return(openParen);
 }
 
-// Helper function creates a close-type value cell
-Value* Close(Value* list)
+// Helper function returns the close-type token
+Value* Close()
 {
-  Value *temp = talloc(sizeof(Value));
-  temp->type = CLOSE_TYPE;
-  char *close = talloc(sizeof(char));
-  *close = ')';
-  temp->s = close;
-  list = cons(temp,list);
-  return(list);
+  return(closeParen);
 }
 
 // Helper function creates a float-type value cell
-Value* leadingDecimal(Value* list, char sign)
+Value* leadingDecimal(char sign)
 {
-  int flag = 0; // Used in distinguishing 0.1 vs. 0.1( without use of whitespace
+  Decimal number = {0};
+  number.negative = sign == '-';
+  numberPoint(&number);
   char charRead;
-  charRead = fgetc(stdin);
+  charRead = nextChar();
   if (48 <= (int)charRead && (int)charRead <= 57) {  // If we see a number : Leading decimal FLOAT
 
-    Value *temp = talloc(sizeof(Value));
-    temp->type = DOUBLE_TYPE;
-    int i = 0;
-    char buffer[MAX_LEN + 1] = ""; // not an issue since we'll be using atoi and atof
-    buffer[0] = '.';
-
-    if (sign == '+') { // handles there being an appended sign
-      buffer[0] = '+';
-      i = 2;
-    } else if (sign == '-') {
-      buffer[0] = '-';
-      i = 2;
-    } else {
-      i = 1;
-    }
-
-    buffer[i] = charRead;
     while (charRead != ' ') { // While not whitespace or newline
 
       if (48 <= (int)charRead && (int)charRead <= 57) {
 
-        buffer[i] = charRead; // place digit in buffer
-        charRead = fgetc(stdin);
+        numberDigit(&number, charRead);
+        charRead = nextChar();
 
       } else if ((int)charRead == 40 || (int)charRead == 41) { // followed by paren
 
-        if((int)charRead == 40){
-          flag = 1; // flag followed by open
-        } else {
-          flag = 2; // flag followed by close
-        }
         break;
 
       } else {
@@ -207,65 +504,38 @@ Value* leadingDecimal(Value* list, char sign)
         texit(EXIT_FAILURE);
         break;
       }
-      i++;
-    }
-    temp->d = atof(buffer); // Store the FLOAT from the buffer
-    list = cons(temp,list);
-
-    // Comes after to append the token in the right spot of the linked list
-    if (flag == 1) {
-      list = Open(list);
-    } else if (flag == 2) {
-      list = Close(list);
-    } else {
-      // Do nothing
     }
+    endToken(charRead);
+    return(makeDouble(decimalToDouble(&number, mark))); // mark is the sign or '.'
 
   } else {
     // Error
     fprintf(stderr, "Error: Leading decimal followed by chars.\n");
     texit(EXIT_FAILURE);
   }
-  return(list);
+  return(NULL);
 }
 
-Value* leadingDigit(Value* list, char charRead, char sign)
+Value* leadingDigit(char charRead, char sign)
 {
-  int flag = 0;
-  Value *temp = talloc(sizeof(Value));
-  temp->type = NULL_TYPE;
-  char buffer[MAX_LEN + 1] = "";
-  int i = 0;
-
-  if (sign == '+') {
-    buffer[0] = '+';
-    i = 1;
-  } else if (sign == '-') {
-    buffer[0] = '-';
-    i = 1;
-  } else {
-    i = 0;
-  }
+  int isDouble = 0;
+  Decimal number = {0};
+  number.negative = sign == '-';
 
   while (charRead != ' ' && charRead != '\n') { // whitespace or newline
     if (charRead == '.') {
 
-      temp->type = DOUBLE_TYPE;
-      buffer[i] = '.';
-      charRead = fgetc(stdin);
+      isDouble = 1;
+      numberPoint(&number);
+      charRead = nextChar();
 
     } else if (48 <= (int)charRead && (int)charRead <= 57) {
 
-      buffer[i] = charRead;
-      charRead = fgetc(stdin);
+      numberDigit(&number, charRead);
+      charRead = nextChar();
 
     } else if ((int)charRead == 40 || (int)charRead == 41) { // followed by paren
 
-      if((int)charRead == 40){
-        flag = 1;
-      } else {
-        flag = 2;
-      }
       break;
 
     } else {
@@ -274,106 +544,71 @@ Value* leadingDigit(Value* list, char charRead, char sign)
       texit(EXIT_FAILURE);
       break;
     }
-    i++;
   }
+  endToken(charRead);
 
-  if (temp->type != DOUBLE_TYPE) { // If temp not already declared a double
-    temp->type = INT_TYPE;
-    temp->i = atoi(buffer); // INT
-  } else {
-    temp->d = atof(buffer); // FLOAT
-  }
-
-  list = cons(temp,list);
-
-  if (flag == 1) {
-    list = Open(list);
-  } else if (flag == 2) {
-    list = Close(list);
-  } else {
-    // regular case
-  }
-
-  return(list);
+  return(numberValue(&number, mark, isDouble)); // INT or FLOAT; mark is the sign or first digit
 }
 
-Value* leadingSymbol(Value* list, char charRead, char sign)
+Value* leadingSymbol(char charRead, char sign)
 {
-  int flag = 0;
-  Value *temp = talloc(sizeof(Value));
-  char *buffer = talloc(sizeof(char)*(MAX_LEN + 1));
-  int i;
   if (sign != '+' && sign !='-') { // leading Non +/-
-    buffer[0] = charRead;
-    i = 1;
-    charRead = fgetc(stdin);
-    while (((int)charRead >= 33 && (int)charRead <= 126) &&
-    ((int)charRead != 40 && (int)charRead != 41)) {
-      buffer[i] = charRead;
-      i++;
-      charRead = fgetc(stdin);
-    }
-
-    if ((int)charRead == 40){
-      flag = 1;
-    } else if ((int)charRead == 41){
-      flag = 2;
-    } else {
-      // regular case
-    }
-
-  } else { // +/- on its own
-    buffer[0] = sign;
-    i = 1;
-  }
-  buffer[i] = '\0';
-  temp->type = SYMBOL_TYPE;
-  temp->s = buffer;
-  list = cons(temp,list);
-
-  if (flag == 1) {
-    list = Open(list);
-  } else if (flag == 2) {
-    list = Close(list);
-  } else {
-    // regular case
-  }
-  return(list);
+    skip(SCAN_SYMBOL_END);
+    charRead = nextChar();
+  } // else +/- on its own, followed by the space in charRead
+  endToken(charRead);
+  return(streaming ? internCopy(mark) : intern(mark));
 }
 
-Value* leadingQuote(Value* list)
+Value* leadingQuote()
 {
-  Value *temp = talloc(sizeof(Value));
+  Value *temp = gcAllocValue();
   char charRead;
-  char *buffer = talloc(sizeof(char)*(MAX_LEN + 1));
-  buffer[0] = '"';
-  int i = 1;
-  charRead = fgetc(stdin);
-  while ((int)charRead != 34) { // Read in until endquote is found
-    buffer[i] = charRead;
-    i++;
-    charRead = fgetc(stdin);
-    if (charRead == EOF) {
-      // Error
-      fprintf(stderr, "Error: EndQuote not found\n");
-      texit(EXIT_FAILURE);
-    }
+  skip(SCAN_QUOTE); // Read in until endquote is found
+  charRead = nextChar();
+  if (charRead == EOF) {
+    // Error
+    fprintf(stderr, "Error: EndQuote not found\n");
+    texit(EXIT_FAILURE);
+  }
+  if (cursor == inputEnd) {
+    refill(); // to see what follows the string
+  }
+
+  // The terminator goes after the closing quote, over a character that
+  // hasn't been read yet. That's fine to hold back for nextChar if it can't
+  // start another lexeme; otherwise the string is copied out instead, as it
+  // always is from a streamed buffer.
+  char *lexeme = mark; // the opening quote; the token keeps both quotes
+  size_t length = cursor - lexeme;
+  int next = cursor < inputEnd ? (unsigned char)*cursor : EOF;
+  int copy = streaming;
+  if (next == EOF) {
+    *cursor = '\0'; // the spare byte after the input
+  } else if (next <= 32 || next > 126 || next == 40 || next == 41) {
+    held = next;
+    *cursor++ = '\0';
+  } else {
+    copy = 1;
+  }
+  if (copy) {
+    lexeme = talloc(length + 1);
+    memcpy(lexeme, mark, length);
+    lexeme[length] = '\0';
   }
-  buffer[i] = '"';
-  buffer[i+1] = '\0';
   temp->type = STR_TYPE;
-  temp->s = buffer;
-  list = cons(temp,list);
-  return(list);
+  countAlloc(SITE_TOKEN, STR_TYPE, sizeof(Value));
+  temp->s = lexeme;
+  return(temp);
 }
 
 // Displays the contents of the linked list as tokens, with type information
 void displayTokens(Value *list)
 {
-  for (;list->type == CONS_TYPE; list = list->c.cdr) { //increment through the list
-    switch (list->c.car->type) {
+  for (;typeOf(list) == CONS_TYPE; list = list->c.cdr) { //increment through the list
+    switch (typeOf(list->c.car)) {
     case INT_TYPE:
-        printf("%i : integer\n", list->c.car->i);
+        printf("%ld : integer\n", intOf(list->c.car));
         break;
     case DOUBLE_TYPE:
         printf("%f : float\n", list->c.car->d);
@@ -386,7 +621,7 @@ void displayTokens(Value *list)
         printf("END\n");
         break;
     case BOOL_TYPE:
-        if(list->c.car->i == 0){
+        if(intOf(list->c.car) == 0){
           printf("#f : boolean\n");
         } else {
           printf("#t : boolean\n");
@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include "value.h"
 
 #ifndef _TOKENIZER
@@ -7,6 +8,35 @@
 // tokens.
 Value *tokenize();
 
+// The two halves of tokenize. readInput brings all of stdin into memory and
+// returns it, with its size; tokenizeRange tokenizes the bytes from start to
+// end. Lexemes are terminated in place, by writing over the byte after them,
+// so a range other than the last must end in whitespace (or the next range
+// would lose its first byte), and each range can only be tokenized once.
+char *readInput(size_t *size);
+Value *tokenizeRange(char *start, char *end);
+
+// Reading tokens one at a time, for readDatum. openInput gets stdin ready:
+// a regular file is brought in whole, as by readInput, and anything else is
+// read as nextToken gets to it, so that a pipe or a terminal can be answered
+// form by form. nextToken returns the next token, or NULL at the end of the
+// input.
+void openInput();
+Value *nextToken();
+
+// Points nextToken at the bytes from start to end, with the same rules as
+// tokenizeRange.
+void openRange(char *start, char *end);
+
+// The tokenizer's scanning layer, exported for scanbench. scanFor returns the
+// first byte at or after p, and before end, of the class kind names (or end):
+// SCAN_TOKEN, anything but whitespace and other skipped bytes; SCAN_SYMBOL_END,
+// whitespace or a paren; SCAN_NEWLINE and SCAN_QUOTE, '\n' and '"'. It uses
+// SSE2 compares in optimized builds, unless scalarScan is set.
+enum {SCAN_TOKEN, SCAN_SYMBOL_END, SCAN_NEWLINE, SCAN_QUOTE};
+char *scanFor(int kind, char *p, char *end);
+extern int scalarScan;
+
 // Displays the contents of the linked list as tokens, with type information
 void displayTokens(Value *list);
 
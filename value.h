@@ -1,13 +1,15 @@
 #ifndef _VALUE
 #define _VALUE
 
+#include <stdint.h>
+
 typedef enum {INT_TYPE,DOUBLE_TYPE,STR_TYPE,CONS_TYPE,NULL_TYPE,PTR_TYPE,
               OPEN_TYPE,CLOSE_TYPE,BOOL_TYPE,SYMBOL_TYPE,VOID_TYPE,CLOSURE_TYPE,PRIMITIVE_TYPE} valueType;
 
 struct Value {
     valueType type;
     union {
-        int i;
+        long i;
         double d;
         char *s;
         void *p;
@@ -16,17 +18,78 @@ struct Value {
             struct Value *cdr;
         } c;
         struct Closure {
-            struct Value *paramNames;
-            struct Value *functionCode;
+            struct Node *functionCode; // its LAMBDA_NODE (analyze.h)
             struct Frame *frame;
         } cl;
         // A primitive style function; just a pointer to it, with the right
-       // signature (pf = my chosen variable for a primitive function)
-       struct Value *(*pf)(struct Value *);
+       // signature (pf = my chosen variable for a primitive function). It
+       // gets its argc evaluated arguments in order at argv.
+       struct Value *(*pf)(int argc, struct Value **argv);
     };
 };
 
 
 typedef struct Value Value;
 
+// Small integers, booleans, the empty list and void are never allocated: they
+// are encoded in the Value pointer itself. A pointer with its low bit set is a
+// fixnum (the integer shifted left by one), and one whose low three bits are
+// 010 is one of the constants below. Every other Value* points at a struct
+// Value, which is always 8-byte aligned. So read a value's type with typeOf()
+// and an integer or boolean with intOf() instead of ->type and ->i.
+#define FIXNUM_TAG  1
+#define CONST_TAG   2
+#define TAG_MASK    7
+
+// The integers a fixnum can hold, one bit short of a pointer.
+#define FIXNUM_MAX  (INTPTR_MAX >> 1)
+#define FIXNUM_MIN  (INTPTR_MIN >> 1)
+#define fitsFixnum(i) ((i) >= FIXNUM_MIN && (i) <= FIXNUM_MAX)
+
+#define FALSE_VALUE ((Value *)(intptr_t)0x02)
+#define TRUE_VALUE  ((Value *)(intptr_t)0x0a)
+#define NULL_VALUE  ((Value *)(intptr_t)0x12)
+#define VOID_VALUE  ((Value *)(intptr_t)0x1a)
+
+static inline int isImmediate(Value *value)
+{
+  return(((intptr_t)value & TAG_MASK) != 0);
+}
+
+static inline valueType typeOf(Value *value)
+{
+  intptr_t bits = (intptr_t)value;
+  if (bits & FIXNUM_TAG) {
+    return(INT_TYPE);
+  }
+  if (bits & TAG_MASK) {
+    static const valueType constants[] = {BOOL_TYPE, BOOL_TYPE, NULL_TYPE, VOID_TYPE};
+    return(constants[(bits >> 3) & 3]);
+  }
+  return(value->type);
+}
+
+// The integer of a fixnum, 1 or 0 for a boolean, 0 for null and void.
+static inline long intOf(Value *value)
+{
+  intptr_t bits = (intptr_t)value;
+  if (bits & FIXNUM_TAG) {
+    return((long)(bits >> 1));
+  }
+  if (bits & TAG_MASK) {
+    return(value == TRUE_VALUE);
+  }
+  return(value->i);
+}
+
+static inline Value *makeInt(long i)
+{
+  return((Value *)(((uintptr_t)(intptr_t)i << 1) | FIXNUM_TAG));
+}
+
+static inline Value *makeBool(int b)
+{
+  return(b ? TRUE_VALUE : FALSE_VALUE);
+}
+
 #endif
@@ -0,0 +1,698 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "gc.h"
+#include "global.h"
+#include "analyze.h"
+#include "interpreter.h"
+#include "vm.h"
+
+// The compiler walks a node tree the way exec would run it and emits an
+// instruction for each step exec takes. The instructions work on a stack of
+// Values; let forms and calls also keep frames and return state on it.
+//
+//   CONST k          push constant k
+//   LOCAL d i        push slot i of the frame d parents up
+//   GLOBAL k         push the value in binding cell k (global.h)
+//   POP              drop the top
+//   JUMP d           continue d words on from the operand
+//   IF_FALSE d       pop a test that must be 0 or 1, jump if 0
+//   TEST_FALSE d     pop a test, jump if 0 (cond)
+//   REPLACE          pop a value into the slot below it (cond's result)
+//   AND_TEST d       if the top is 0 make it #f and jump, else pop it
+//   OR_TEST d        if the top isn't 0 make it #t and jump, else pop it
+//   TO_BOOL          make the top #t or #f
+//   FRAME n          push the frame and a new frame of n slots under it
+//   BIND i           pop a value into slot i of the new frame
+//   DUMMY i          put void in slot i of the new frame (letrec)
+//   ENTER            run in the new frame from now on
+//   FILL i           pop a value that letrec may bind into slot i of the
+//                    new frame
+//   LEAVE            pop the result and the let frame, go back to the old
+//                    frame and push the result
+//   CLOSURE k        push a closure of LAMBDA_NODE k
+//   DEFINE k         pop a value into binding cell k unless k is NULL, push
+//                    void
+//   SET_LOCAL d i    pop a value and set! slot i of the frame d parents up
+//                    to it, push void
+//   SET_GLOBAL k     pop a value and set! binding cell k to it, push void
+//   CALL n k         call the function under n arguments; k is the operator
+//                    as written, which names the call in heap profiles
+//   TAIL_CALL n l k  the same from tail position l let frames deep, in place
+//                    of the function making it
+//   RETURN           pop the result and go back to the caller
+//   ERROR k          print string k and stop
+//   HALT             end of a top-level form; the top is its value
+//
+// A call saves CALL_WORDS words: the caller's frame, code, instruction (an
+// int), profile node and frame pointer (ints too). Above them are the
+// callee's own slots, which start at the frame pointer.
+enum {OP_CONST, OP_LOCAL, OP_GLOBAL, OP_POP, OP_JUMP, OP_IF_FALSE,
+      OP_TEST_FALSE, OP_REPLACE, OP_AND_TEST, OP_OR_TEST, OP_TO_BOOL, OP_FRAME,
+      OP_BIND, OP_DUMMY, OP_ENTER, OP_FILL, OP_LEAVE, OP_CLOSURE, OP_DEFINE,
+      OP_SET_LOCAL, OP_SET_GLOBAL, OP_CALL, OP_TAIL_CALL, OP_RETURN, OP_ERROR,
+      OP_HALT, OP_COUNT};
+
+static const int operandCounts[OP_COUNT] = {1, 2, 1, 0, 1, 1, 1, 0, 1, 1, 0, 1,
+                                            1, 1, 0, 1, 0, 1, 1, 2, 1, 2, 3, 0,
+                                            1, 0};
+
+#define CALL_WORDS 5
+
+int useVM = 0;
+
+void **opLabels = NULL; // the address of the code for each instruction
+
+// The stack, registered with the collector. Between safepoints the running
+// VM keeps its registers in locals; at one they are saved here.
+Value **stack = NULL;
+Value **stackEnd = NULL;
+Value **vmTop = NULL;
+Value **vmLow = NULL; // at or below the frame pointer of everything run since the last collection
+Frame *vmEnv = NULL;
+Code *vmCode = NULL;
+
+// The code being compiled. Lambdas are compiled when first called, not
+// along with the code that makes them, so one buffer is enough.
+void **words = NULL;
+int wordCount = 0;
+int wordCapacity = 0;
+void **constants = NULL;
+int constantCount = 0;
+int constantCapacity = 0;
+int depth = 0;    // stack slots in use at this point of the code
+int maxDepth = 0;
+
+static void **grow(void **array, int count, int *capacity)
+{
+  int newCapacity = *capacity == 0 ? 256 : *capacity * 2;
+  void **bigger = talloc(sizeof(void *) * newCapacity);
+  if (count > 0) {
+    memcpy(bigger, array, sizeof(void *) * count);
+  }
+  *capacity = newCapacity;
+  return(bigger);
+}
+
+static void emit(void *word)
+{
+  if (wordCount == wordCapacity) {
+    words = grow(words, wordCount, &wordCapacity);
+  }
+  words[wordCount++] = word;
+}
+
+// Emits an instruction that changes the stack depth by effect; its operands
+// follow with emit.
+static void emitOp(int op, int effect)
+{
+  emit((void *)(intptr_t)op);
+  depth += effect;
+  if (depth > maxDepth) {
+    maxDepth = depth;
+  }
+}
+
+static void emitConstant(void *constant)
+{
+  if (constantCount == constantCapacity) {
+    constants = grow(constants, constantCount, &constantCapacity);
+  }
+  constants[constantCount] = constant;
+  emit((void *)(intptr_t)constantCount++);
+}
+
+// Emits a jump operand to fill in with patch once the target is known.
+static int emitJump()
+{
+  emit(NULL);
+  return(wordCount - 1);
+}
+
+// Points the jump operand at from to the next instruction.
+static void patch(int from)
+{
+  words[from] = (void *)(intptr_t)(wordCount - from);
+}
+
+// Emits a jump operand that holds where the previous one in chain is until
+// patchChain points them all at the same place; 0 is an empty chain, since
+// the first word is always an instruction. Returns the new chain.
+static int emitChainedJump(int chain)
+{
+  emit((void *)(intptr_t)chain);
+  return(wordCount - 1);
+}
+
+static void patchChain(int chain)
+{
+  while (chain != 0) {
+    int previous = (intptr_t)words[chain];
+    patch(chain);
+    chain = previous;
+  }
+}
+
+// Emits code for node. tail is set in the tail position of a lambda body,
+// inside lets let frames.
+static void compile(Node *node, int tail, int lets)
+{
+  checkStack(&node);
+  switch (node->type) {
+  case CONST_NODE:
+    emitOp(OP_CONST, 1);
+    emitConstant(node->value);
+    break;
+
+  case LOCAL_NODE:
+    emitOp(OP_LOCAL, 1);
+    emit((void *)(intptr_t)node->depth);
+    emit((void *)(intptr_t)node->slot);
+    break;
+
+  case GLOBAL_NODE:
+    emitOp(OP_GLOBAL, 1);
+    emitConstant(node->value);
+    break;
+
+  case IF_NODE: {
+    compile(node->kids[0], 0, lets);
+    emitOp(OP_IF_FALSE, -1);
+    int toElse = emitJump();
+    compile(node->kids[1], tail, lets);
+    emitOp(OP_JUMP, -1); // the else branch starts from the depth the then one did
+    int toEnd = emitJump();
+    patch(toElse);
+    compile(node->kids[2], tail, lets);
+    patch(toEnd);
+    break;
+  }
+
+  case LET_NODE:
+  case LETSTAR_NODE: {
+    // let's expressions run in the enclosing frame, let*'s in the new one
+    int count = node->count - 1;
+    emitOp(OP_FRAME, 2);
+    emit((void *)(intptr_t)count);
+    if (node->type == LETSTAR_NODE) {
+      emitOp(OP_ENTER, 0);
+    }
+    for (int i = 0; i < count; i++) {
+      compile(node->kids[i], 0, lets);
+      emitOp(OP_BIND, -1);
+      emit((void *)(intptr_t)i);
+    }
+    if (node->type == LET_NODE) {
+      emitOp(OP_ENTER, 0);
+    }
+    compile(node->kids[count], tail, lets + 1);
+    emitOp(OP_LEAVE, -2);
+    break;
+  }
+
+  case LETREC_NODE: {
+    int count = node->count - 1;
+    emitOp(OP_FRAME, 2);
+    emit((void *)(intptr_t)count);
+    for (int i = 0; i < count; i++) {
+      emitOp(OP_DUMMY, 0);
+      emit((void *)(intptr_t)i);
+    }
+    emitOp(OP_ENTER, 0);
+    for (int i = 0; i < count; i++) {
+      compile(node->kids[i], 0, lets + 1);
+      emitOp(OP_FILL, -1);
+      emit((void *)(intptr_t)(count - 1 - i)); // the last name first, as exec does
+    }
+    compile(node->kids[count], tail, lets + 1);
+    emitOp(OP_LEAVE, -2);
+    break;
+  }
+
+  case LAMBDA_NODE:
+    emitOp(OP_CLOSURE, 1);
+    emitConstant(node);
+    break;
+
+  case DEFINE_NODE:
+    compile(node->kids[0], 0, lets);
+    emitOp(OP_DEFINE, 0);
+    emitConstant(node->value);
+    break;
+
+  case SET_NODE:
+    compile(node->kids[0], 0, lets);
+    if (node->depth < 0) {
+      emitOp(OP_SET_GLOBAL, 0);
+      emitConstant(node->value);
+    } else {
+      emitOp(OP_SET_LOCAL, 0);
+      emit((void *)(intptr_t)node->depth);
+      emit((void *)(intptr_t)node->slot);
+    }
+    break;
+
+  case BEGIN_NODE:
+    for (int i = 0; i < node->count - 1; i++) {
+      compile(node->kids[i], 0, lets);
+      emitOp(OP_POP, -1);
+    }
+    compile(node->kids[node->count - 1], tail, lets);
+    break;
+
+  case COND_NODE: {
+    // The result starts out void, and each clause that runs replaces it.
+    // An else clause doesn't end the cond; a true test does.
+    int ends = 0;
+    emitOp(OP_CONST, 1);
+    emitConstant(VOID_VALUE);
+    for (int i = 0; i < node->count; i += 2) {
+      Node *test = node->kids[i];
+      Node *expr = node->kids[i + 1];
+      if (test == NULL) {
+        compile(expr, tail && i + 2 == node->count, lets);
+        emitOp(OP_REPLACE, -1);
+      } else if (expr == NULL) { // a clause of the wrong shape; its test stops
+        compile(test, 0, lets);
+        emitOp(OP_POP, -1);
+      } else {
+        compile(test, 0, lets);
+        emitOp(OP_TEST_FALSE, -1);
+        int next = emitJump();
+        compile(expr, tail, lets);
+        emitOp(OP_REPLACE, -1);
+        emitOp(OP_JUMP, 0);
+        ends = emitChainedJump(ends);
+        patch(next);
+      }
+    }
+    patchChain(ends);
+    break;
+  }
+
+  case AND_NODE:
+  case OR_NODE: {
+    if (node->count == 0) {
+      emitOp(OP_CONST, 1);
+      emitConstant(node->type == AND_NODE ? TRUE_VALUE : FALSE_VALUE);
+      break;
+    }
+    int ends = 0;
+    for (int i = 0; i < node->count - 1; i++) {
+      compile(node->kids[i], 0, lets);
+      emitOp(node->type == AND_NODE ? OP_AND_TEST : OP_OR_TEST, -1);
+      ends = emitChainedJump(ends);
+    }
+    compile(node->kids[node->count - 1], 0, lets);
+    emitOp(OP_TO_BOOL, 0);
+    patchChain(ends);
+    break;
+  }
+
+  case CALL_NODE:
+    for (int i = 0; i < node->count; i++) {
+      compile(node->kids[i], 0, lets);
+    }
+    emitOp(tail ? OP_TAIL_CALL : OP_CALL, 1 - node->count);
+    emit((void *)(intptr_t)(node->count - 1));
+    if (tail) {
+      emit((void *)(intptr_t)lets);
+    }
+    emitConstant(node->value);
+    break;
+
+  case ERROR_NODE:
+    emitOp(OP_ERROR, 1); // never returns, but the code after expects a value
+    emitConstant(node->value);
+    break;
+  }
+}
+
+// Compiles body, a lambda's or a top-level form's, into a new Code.
+static Code *compileCode(Node *body, int function)
+{
+  wordCount = 0;
+  constantCount = 0;
+  depth = 0;
+  maxDepth = 0;
+  compile(body, function, 0);
+  emitOp(function ? OP_RETURN : OP_HALT, 0);
+
+  Code *code = gcAllocCode(constantCount, wordCount);
+  countAlloc(SITE_COMPILE, CODE_STAT, sizeof(Code) + sizeof(void *) * (constantCount + wordCount));
+  code->length = wordCount;
+  code->constantCount = constantCount;
+  code->maxStack = maxDepth;
+  memcpy(code->words, constants, sizeof(void *) * constantCount);
+  void **start = CODE_START(code);
+  for (int i = 0; i < wordCount; ) { // thread it: each opcode becomes its address
+    int op = (intptr_t)words[i];
+    start[i++] = opLabels[op];
+    for (int j = 0; j < operandCounts[op]; j++, i++) {
+      start[i] = words[i];
+    }
+  }
+  return(code);
+}
+
+// Makes sure slots more stack slots fit above *sp, moving the stack if
+// they don't; *sp, *fp and vmLow are moved with it.
+static void reserve(Value ***sp, Value ***fp, int slots)
+{
+  if (*sp + slots <= stackEnd) {
+    return;
+  }
+  size_t used = *sp - stack;
+  size_t base = *fp - stack;
+  size_t size = stackEnd - stack;
+  while (size < used + slots) {
+    size *= 2;
+  }
+  size_t low = vmLow - stack;
+  stack = gcResizeStack(stack, sizeof(Value *) * (stackEnd - stack), sizeof(Value *) * size);
+  vmLow = stack + low;
+  stackEnd = stack + size;
+  *sp = stack + used;
+  *fp = stack + base;
+}
+
+static Code *codeOf(Value *closure)
+{
+  Node *lambda = closure->cl.functionCode;
+  if (lambda->code == NULL) {
+    lambda->code = compileCode(lambda->kids[0], 1);
+    gcWriteBarrier(lambda);
+  }
+  return(lambda->code);
+}
+
+static const char *callName(Value *operator)
+{
+  return(typeOf(operator) == SYMBOL_TYPE ? operator->s : "lambda");
+}
+
+#define NEXT goto *(*ip++)
+
+// A collection may move the code and the frames, so the registers are
+// saved where the collector sees them and reloaded afterwards. Code only
+// writes the stack from its frame pointer up, so that is as low as vmLow has
+// to go; a collection leaves it at the top.
+#define SAFEPOINT() do {                        \
+    long pc = ip - CODE_START(code);            \
+    vmTop = sp;                                 \
+    vmEnv = env;                                \
+    vmCode = code;                              \
+    gcSafepoint();                              \
+    code = vmCode;                              \
+    env = vmEnv;                                \
+    ip = CODE_START(code) + pc;                 \
+    if (fp < vmLow) {                           \
+      vmLow = fp;                               \
+    }                                           \
+  } while (0)
+
+// Runs code in env with the stack empty and returns what it leaves. Called
+// with NULL code first, just to fill in opLabels.
+static Value *run(Code *code, Frame *env)
+{
+  static void *labels[OP_COUNT] = {
+    &&op_const, &&op_local, &&op_global, &&op_pop, &&op_jump, &&op_if_false,
+    &&op_test_false, &&op_replace, &&op_and_test, &&op_or_test, &&op_to_bool,
+    &&op_frame, &&op_bind, &&op_dummy, &&op_enter, &&op_fill, &&op_leave,
+    &&op_closure, &&op_define, &&op_set_local, &&op_set_global, &&op_call,
+    &&op_tail_call, &&op_return, &&op_error, &&op_halt};
+  if (code == NULL) {
+    opLabels = labels;
+    return(NULL);
+  }
+
+  Value **sp = stack;
+  Value **fp = stack;
+  void **ip = CODE_START(code);
+  reserve(&sp, &fp, code->maxStack + CALL_WORDS);
+  NEXT;
+
+op_const:
+  *sp++ = code->words[(intptr_t)*ip++];
+  NEXT;
+
+op_local: {
+  Frame *frame = env;
+  for (intptr_t up = (intptr_t)ip[0]; up > 0; up--) {
+    frame = frame->parent;
+  }
+  *sp++ = frame->slots[(intptr_t)ip[1]];
+  ip += 2;
+  NEXT;
+}
+
+op_global:
+  *sp++ = lookUpGlobal(code->words[(intptr_t)*ip++]);
+  NEXT;
+
+op_pop:
+  sp--;
+  NEXT;
+
+op_jump:
+  ip += (intptr_t)*ip;
+  NEXT;
+
+op_if_false: {
+  long bool_val = intOf(*--sp);
+  if (bool_val != 0 && bool_val != 1) {
+    printf("if arg not a boolean.\n");
+    evaluationError();
+  }
+  ip += bool_val ? 1 : (intptr_t)*ip;
+  NEXT;
+}
+
+op_test_false:
+  ip += intOf(*--sp) ? 1 : (intptr_t)*ip;
+  NEXT;
+
+op_replace:
+  sp--;
+  sp[-1] = sp[0];
+  NEXT;
+
+op_and_test:
+  if (!intOf(sp[-1])) {
+    sp[-1] = FALSE_VALUE;
+    ip += (intptr_t)*ip;
+  } else {
+    sp--;
+    ip++;
+  }
+  NEXT;
+
+op_or_test:
+  if (intOf(sp[-1])) {
+    sp[-1] = TRUE_VALUE;
+    ip += (intptr_t)*ip;
+  } else {
+    sp--;
+    ip++;
+  }
+  NEXT;
+
+op_to_bool:
+  sp[-1] = makeBool(intOf(sp[-1]));
+  NEXT;
+
+op_frame: {
+  Frame *frame = newFrame(SITE_LET_FRAME, (intptr_t)*ip++, env);
+  *sp++ = (Value *)env;
+  *sp++ = (Value *)frame;
+  NEXT;
+}
+
+op_bind: {
+  Value *val = *--sp;
+  Frame *frame = (Frame *)sp[-1];
+  frame->slots[(intptr_t)*ip++] = val;
+  gcWriteBarrier(frame); // a call in the expression may have promoted it
+  NEXT;
+}
+
+op_dummy:
+  ((Frame *)sp[-1])->slots[(intptr_t)*ip++] = VOID_VALUE;
+  NEXT;
+
+op_enter:
+  env = (Frame *)sp[-1];
+  NEXT;
+
+op_fill: {
+  Value *val = *--sp;
+  switch (typeOf(val)) {
+  case NULL_TYPE:
+  case OPEN_TYPE:
+  case CLOSE_TYPE:
+  case PTR_TYPE:
+  case PRIMITIVE_TYPE:
+  case CONS_TYPE:
+    printf("letrec val error\n");
+    evaluationError();
+  default:
+    break;
+  }
+  env->slots[(intptr_t)*ip++] = val;
+  gcWriteBarrier(env);
+  NEXT;
+}
+
+op_leave: {
+  Value *result = *--sp;
+  Frame *frame = (Frame *)*--sp;
+  env = (Frame *)*--sp;
+  releaseFrame(frame);
+  *sp++ = result;
+  NEXT;
+}
+
+op_closure:
+  *sp++ = evalLambda(code->words[(intptr_t)*ip++], env);
+  NEXT;
+
+op_define: {
+  Value *cell = code->words[(intptr_t)*ip++];
+  if (cell != NULL) {
+    cell->c.cdr = sp[-1];
+  }
+  sp[-1] = VOID_VALUE;
+  NEXT;
+}
+
+op_set_local:
+  setLocal(env, (intptr_t)ip[0], (intptr_t)ip[1], sp[-1]);
+  sp[-1] = VOID_VALUE;
+  ip += 2;
+  NEXT;
+
+op_set_global:
+  setGlobal(code->words[(intptr_t)*ip++], sp[-1]);
+  sp[-1] = VOID_VALUE;
+  NEXT;
+
+op_call: {
+  int argc = (intptr_t)ip[0];
+  Value *function = sp[-argc - 1];
+  if (typeOf(function) != CLOSURE_TYPE) {
+    Value *result = apply(function, argc, sp - argc);
+    sp -= argc;
+    sp[-1] = result;
+    ip += 2;
+    NEXT;
+  }
+  if (++evalSteps > maxEvalSteps) {
+    limitError("step", maxEvalSteps, EXIT_STEP_LIMIT);
+  }
+  if (++evalDepth > maxEvalDepth) {
+    limitError("recursion depth", maxEvalDepth, EXIT_DEPTH_LIMIT);
+  }
+  Frame *frame = bindArgs(function, argc, sp - argc);
+  Value *operator = code->words[(intptr_t)ip[1]];
+  sp -= argc + 1;
+  sp[0] = (Value *)env;
+  sp[1] = (Value *)code;
+  sp[2] = makeInt(ip + 2 - CODE_START(code));
+  sp[3] = makeInt((long)profileNode);
+  sp[4] = makeInt(fp - stack);
+  sp += CALL_WORDS;
+  fp = sp;
+  if (profileNode != NULL) {
+    profileEnter(callName(operator)); // charge the call to the callee
+  }
+  env = frame;
+  code = codeOf(function);
+  ip = CODE_START(code);
+  reserve(&sp, &fp, code->maxStack + CALL_WORDS);
+  SAFEPOINT();
+  NEXT;
+}
+
+op_tail_call: {
+  int argc = (intptr_t)ip[0];
+  Value *function = sp[-argc - 1];
+  if (typeOf(function) != CLOSURE_TYPE) { // the code after returns it
+    Value *result = apply(function, argc, sp - argc);
+    sp -= argc;
+    sp[-1] = result;
+    ip += 3;
+    NEXT;
+  }
+  if (++evalSteps > maxEvalSteps) {
+    limitError("step", maxEvalSteps, EXIT_STEP_LIMIT);
+  }
+  Frame *frame = bindArgs(function, argc, sp - argc);
+  // the let frames and the frame of the call being replaced are done with
+  for (intptr_t lets = (intptr_t)ip[1]; lets >= 0; lets--) {
+    Frame *parent = env->parent;
+    releaseFrame(env);
+    env = parent;
+  }
+  if (profileNode != NULL) {
+    // under the function the replaced one returns to, kept in its call's words
+    profileNode = (ProfileNode *)intOf(fp[3 - CALL_WORDS]);
+    profileEnter(callName(code->words[(intptr_t)ip[2]]));
+  }
+  sp = fp;
+  env = frame;
+  code = codeOf(function);
+  ip = CODE_START(code);
+  reserve(&sp, &fp, code->maxStack + CALL_WORDS);
+  SAFEPOINT();
+  NEXT;
+}
+
+op_return: {
+  Value *result = *--sp;
+  releaseFrame(env);
+  sp = fp - CALL_WORDS;
+  env = (Frame *)sp[0];
+  code = (Code *)sp[1];
+  ip = CODE_START(code) + intOf(sp[2]);
+  profileNode = (ProfileNode *)intOf(sp[3]);
+  fp = stack + intOf(sp[4]);
+  if (fp < vmLow) { // the caller's code writes from here up
+    vmLow = fp;
+  }
+  *sp++ = result;
+  evalDepth--;
+  NEXT;
+}
+
+op_error:
+  printf("%s", ((Value *)code->words[(intptr_t)*ip])->s);
+  evaluationError();
+  NEXT;
+
+op_halt:
+  return(sp[-1]);
+}
+
+Value *vmEval(Node *node)
+{
+  if (opLabels == NULL) {
+    run(NULL, NULL);
+    stack = gcResizeStack(NULL, 0, sizeof(Value *) * 1024);
+    stackEnd = stack + 1024;
+    vmTop = stack;
+    vmLow = stack;
+    gcAddStack((void ***)&stack, (void ***)&vmTop, (void ***)&vmLow);
+    gcAddGlobal(&vmEnv);
+    gcAddGlobal(&vmCode);
+  }
+  Value *result = run(compileCode(node, 0), NULL);
+  vmTop = stack;
+  vmLow = stack;
+  vmEnv = NULL;
+  vmCode = NULL;
+  return(result);
+}
@@ -0,0 +1,34 @@
+#include "value.h"
+
+#ifndef _VM
+#define _VM
+
+struct Node;
+struct Frame;
+
+// The bytecode VM, an alternative to exec for running analyzed forms
+// (analyze.h), chosen with --vm. Each LAMBDA_NODE is compiled to bytecode
+// the first time a closure of it is called, and a top-level form just
+// before it runs. Calls push their return state on a stack of the VM's own
+// instead of the C stack, and calls in tail position reuse the caller's
+// place on it, so neither deep recursion nor long loops use up the C stack.
+// What each form does, and each error it reports, is the same as under exec.
+//
+// The code is direct threaded: each instruction is the address of the
+// code that runs it, followed by its operands, which are numbers or indexes
+// into the constants.
+typedef struct Code {
+  int length;          // words of instructions
+  int constantCount;
+  int maxStack;        // most stack slots the instructions use at once
+  void *words[];       // the constants, then the instructions
+} Code;
+
+#define CODE_START(code) (&(code)->words[(code)->constantCount])
+
+extern int useVM; // set by --vm
+
+// Compiles node, a top-level form, and runs it.
+Value *vmEval(struct Node *node);
+
+#endif